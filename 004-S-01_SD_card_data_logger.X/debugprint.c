@@ -7,6 +7,7 @@
 
 #include "debugprint.h"
 #include <xc.h>
+#include "utl.h"
 #include <stdint.h>
 
 // Defines
@@ -122,136 +123,50 @@ void debugprint_string(char *str) {
 
 void debugprint_int(int32_t value) {
     char result_str[12];    // minus sign, 10 char value, zero termination
-    char *ptr = result_str, *ptr1 = result_str;
-    char tmp_char;
-    int32_t tmp_value;
-    
-    do {
-        tmp_value = value;
-        value /= 10;
-        *ptr++ = "9876543210123456789" [9 + (tmp_value - value * 10)];
-    } while ( value );
-
-    // Apply negative sign
-    if (tmp_value < 0) *ptr++ = '-';
-    *ptr-- = '\0';
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr--= *ptr1;
-        *ptr1++ = tmp_char;
-    }
     
+    utl_int32_to_dec(value, result_str);
     debugprint_string(result_str);
 }
 
 void debugprint_int_len(int32_t value, uint8_t len) {
     char result_str[12];    // minus sign, 10 char value, zero termination
-    char *ptr = result_str, *ptr1 = result_str;
-    char tmp_char;
-    int32_t tmp_value;
+    uint8_t length;
     
-    do {
-        tmp_value = value;
-        value /= 10;
-        *ptr++ = "9876543210123456789" [9 + (tmp_value - value * 10)];
-        len--;
-    } while (value && len);
-
-    // Apply negative sign
-    if (tmp_value < 0 && len != 0) { 
-        *ptr++ = '-';
-        len--;
+    // Right align in a field of len chars
+    length = utl_int32_to_dec(value, result_str);
+    while (length < len) {
+        debugprint_char(' ');
+        length++;
     }
-
-    do {
-        *ptr++ = ' ';
-        len--;
-    } while (len);
-    
-    *ptr-- = '\0';
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr--= *ptr1;
-        *ptr1++ = tmp_char;
-    }
-    
     debugprint_string(result_str);
 }
 
 void debugprint_uint(uint32_t value) {
     char result_str[11];     // 10 char value, zero termination
-    char *ptr = result_str, *ptr1 = result_str;
-    char tmp_char;
-    uint32_t tmp_value;
-    
-    do {
-        tmp_value = value;
-        value /= 10;
-        *ptr++ = "9876543210123456789" [9 + (tmp_value - value * 10)];
-    } while ( value );
-
-    *ptr-- = '\0';
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr--= *ptr1;
-        *ptr1++ = tmp_char;
-    }
     
+    utl_uint32_to_dec(value, result_str);
     debugprint_string(result_str);
 }
 
 void debugprint_uint_len(uint32_t value, uint8_t len) {
     char result_str[11];     // 10 char value, zero termination
-    char *ptr = result_str, *ptr1 = result_str;
-    char tmp_char;
-    uint32_t tmp_value;
+    uint8_t length;
     
-    do {
-        tmp_value = value;
-        value /= 10;
-        *ptr++ = "9876543210123456789" [9 + (tmp_value - value * 10)];
-        len--;
-    } while (value && len);
-
-    do {
-        *ptr++ = ' ';
-        len--;
-    } while (len);
-    
-    *ptr-- = '\0';
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr--= *ptr1;
-        *ptr1++ = tmp_char;
+    // Right align in a field of len chars
+    length = utl_uint32_to_dec(value, result_str);
+    while (length < len) {
+        debugprint_char(' ');
+        length++;
     }
-    
     debugprint_string(result_str);
 }
 
 void debugprint_hex(uint32_t value) {
     char result_str[9];     // 8 char value, zero termination
-    char *ptr = result_str, *ptr1 = result_str;
-    char tmp_char;
-    uint32_t tmp_value;
-    uint8_t i = 0;
     
-    do {
-        tmp_value = value;
-        value /= 16;
-        *ptr++ = "FEDCBA9876543210123456789ABCDEF" [15 + (tmp_value - value * 16)];
-        i++;
-    } while ( value );
-
-    if ((i & 0b1) != 0) {
-        *ptr++ = '0';
-    }
-    
-    *ptr-- = '\0';
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr--= *ptr1;
-        *ptr1++ = tmp_char;
+    // Always print whole bytes
+    if ((utl_uint32_to_hex(value, result_str) & 0b1) != 0) {
+        debugprint_char('0');
     }
-    
     debugprint_string(result_str);
 }
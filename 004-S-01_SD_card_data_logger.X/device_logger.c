@@ -147,3 +147,14 @@ void get_device_logger_collected_data(logging_buffer_t *buf_ptr) {
         buf_ptr->raw_uint32[i] = logging_buffer.raw_uint32[i];
     }
 }
+
+uint8_t device_logger_check_crc(logging_buffer_t *buf_ptr) {
+    uint32_t crc;
+    
+    crc = utl_calc_crc(buf_ptr->raw_uint8, LOGGING_BUFFER_RAW_8_LEN - 4);
+    if (buf_ptr->crc == crc) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
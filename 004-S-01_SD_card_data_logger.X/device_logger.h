@@ -25,5 +25,9 @@ void device_logger_increase_time_since_boot(uint16_t time_ms);
 
 void get_device_logger_collected_data(logging_buffer_t *buf_ptr);
 
+// Returns 1 when the crc of a buffer from get_device_logger_collected_data() is
+// still valid, 0 when the buffer got corrupted since
+uint8_t device_logger_check_crc(logging_buffer_t *buf_ptr);
+
 #endif	/* DEVICE_LOGGER_H */
 
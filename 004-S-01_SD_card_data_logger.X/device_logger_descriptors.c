@@ -98,6 +98,16 @@ const data_entry_descriptor_t mg_mppt_message_descriptor[MG_MPPT_MESSAGE_COUNT]
     {.name = "voltage out",         .function_code = 0x004, .index = 0x0004, .subindex = 0x04, .start_byte = 0, .type = UINT32,  .unit = "mV"}
 };
 
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+// Filled by sd_logger_collect_timing(), max and rate cover the time since the previous record
+const data_entry_descriptor_t sd_timing_message_descriptor[SD_TIMING_MESSAGE_COUNT] = {
+    {.name = "write max",           .function_code = 0x180, .index = 0x2000, .subindex = 0x01, .start_byte = 0, .type = UINT32,  .unit = "us"},
+    {.name = "write p99",           .function_code = 0x180, .index = 0x2001, .subindex = 0x01, .start_byte = 0, .type = UINT32,  .unit = "us"},
+    {.name = "busy max",            .function_code = 0x180, .index = 0x2002, .subindex = 0x01, .start_byte = 0, .type = UINT32,  .unit = "us"},
+    {.name = "write rate",          .function_code = 0x180, .index = 0x2003, .subindex = 0x01, .start_byte = 0, .type = UINT32,  .unit = "B/s"}
+};
+#endif
+
 // Device list to be logged
 
 device_list_item_t device_list[DEVICE_LIST_COUNT] = {
@@ -111,5 +121,8 @@ device_list_item_t device_list[DEVICE_LIST_COUNT] = {
     {.name = "BATT",    .node_id = 0x02, .msg_descr = mg_battery_message_descriptor, .msg_count = MG_BATTERY_MESSAGE_COUNT},
     {.name = "MPPT05",  .node_id = 0x04, .msg_descr = mg_mppt_message_descriptor, .msg_count = MG_MPPT_MESSAGE_COUNT},
     {.name = "MPPT06",  .node_id = 0x05, .msg_descr = mg_mppt_message_descriptor, .msg_count = MG_MPPT_MESSAGE_COUNT},
-    {.name = "MPPT07",  .node_id = 0x06, .msg_descr = mg_mppt_message_descriptor, .msg_count = MG_MPPT_MESSAGE_COUNT}
+    {.name = "MPPT07",  .node_id = 0x06, .msg_descr = mg_mppt_message_descriptor, .msg_count = MG_MPPT_MESSAGE_COUNT},
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+    {.name = "SDCARD",  .node_id = SD_TIMING_NODE_ID, .msg_descr = sd_timing_message_descriptor, .msg_count = SD_TIMING_MESSAGE_COUNT}
+#endif
 };
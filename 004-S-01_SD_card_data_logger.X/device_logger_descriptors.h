@@ -24,7 +24,22 @@ extern const data_entry_descriptor_t mg_battery_message_descriptor[MG_BATTERY_ME
 #define MG_MPPT_MESSAGE_COUNT 4
 extern const data_entry_descriptor_t mg_mppt_message_descriptor[MG_MPPT_MESSAGE_COUNT];
 
+// Log the sd card write timing as channels of a SDCARD device, which
+// sd_logger_collect_timing() feeds like a node on the bus.
+// Uncomment to enable
+//#define DEVICE_LOGGER_SD_TIMING_CHANNELS
+
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+#define SD_TIMING_NODE_ID 0x7F
+#define SD_TIMING_MESSAGE_COUNT 4
+extern const data_entry_descriptor_t sd_timing_message_descriptor[SD_TIMING_MESSAGE_COUNT];
+
+#define DEVICE_LIST_COUNT 12
+#else
+#define SD_TIMING_MESSAGE_COUNT 0
+
 #define DEVICE_LIST_COUNT 11
+#endif
 extern device_list_item_t device_list[DEVICE_LIST_COUNT];
 
 // We must know the total number of message entries to create buffers
@@ -33,7 +48,8 @@ extern device_list_item_t device_list[DEVICE_LIST_COUNT];
                              1 * HYDROFOIL_CONTROLLER_MESSAGE_COUNT +\
                              1 * GPS_MESSAGE_COUNT +\
                              1 * MG_BATTERY_MESSAGE_COUNT +\
-                             3 * MG_MPPT_MESSAGE_COUNT\
+                             3 * MG_MPPT_MESSAGE_COUNT +\
+                             1 * SD_TIMING_MESSAGE_COUNT\
                             )
 
 // ****************************************************************************
@@ -7,30 +7,66 @@
 
 #include "flash.h"
 #include <stdint.h>
+#include <stdbool.h>
+#if defined(FLASH_STORE_NOR)
+#include "flash_nor.h"
+#elif defined(FLASH_STORE_RTSP)
+#include "flash_rtsp.h"
+#endif
+#if defined(FLASH_STORE_NOR) || defined(FLASH_STORE_RTSP)
+#include "utl.h"
+#include "debugprint.h"
+#endif
+
+static flash_stats_t flash_stats;
+
+#if defined(FLASH_STORE_RAM)
 
 #define FLASH_BUFFER_SIZE 4
 logging_buffer_t flash_buffer[FLASH_BUFFER_SIZE];
-uint16_t flash_buffer_index;
+// Oldest record and the number of records from there on
+uint16_t flash_buffer_tail;
+uint16_t flash_buffer_count;
 
 void flash_init(void) {
-    flash_clear_data();
+    flash_buffer_tail = 0;
+    flash_buffer_count = 0;
 }
 
-void flash_store_logging_data(logging_buffer_t *logging_buffer_ptr) {
-    uint16_t i;
-    
-    if (flash_buffer_index == FLASH_BUFFER_SIZE) {
-        return;
+void flash_handler(void) {
+}
+
+bool flash_is_busy(void) {
+    return false;
+}
+
+uint16_t flash_store_logging_data(logging_buffer_t *logging_buffer_ptr) {
+    uint16_t i, head, overwritten = 0;
+
+    if (flash_buffer_count == FLASH_BUFFER_SIZE) {
+#if defined(FLASH_OVERRUN_OVERWRITE_OLDEST)
+        flash_release_data(1);
+        flash_stats.overwritten++;
+        overwritten = 1;
+#else
+        flash_stats.dropped++;
+        return 0;
+#endif
     }
-    
+
+    head = (flash_buffer_tail + flash_buffer_count) % FLASH_BUFFER_SIZE;
     for (i = 0; i < LOGGING_BUFFER_RAW_32_LEN; i++) {
-        flash_buffer[flash_buffer_index].raw_uint32[i] = logging_buffer_ptr->raw_uint32[i];
+        flash_buffer[head].raw_uint32[i] = logging_buffer_ptr->raw_uint32[i];
+    }
+    flash_buffer_count++;
+    if (flash_buffer_count > flash_stats.records_max) {
+        flash_stats.records_max = flash_buffer_count;
     }
-    flash_buffer_index++;
+    return overwritten;
 }
 
 uint8_t flash_get_flash_full(void) {
-    if (flash_buffer_index == FLASH_BUFFER_SIZE) {
+    if (flash_buffer_count == FLASH_BUFFER_SIZE) {
         return 1;
     } else {
         return 0;
@@ -38,15 +74,20 @@ uint8_t flash_get_flash_full(void) {
 }
 
 uint16_t flash_get_flash_number_of_data(void) {
-    return flash_buffer_index;
+    return flash_buffer_count;
+}
+
+uint16_t flash_get_flash_size(void) {
+    return FLASH_BUFFER_SIZE;
 }
 
 int8_t flash_get_flash_logging_data(logging_buffer_t *logging_buffer_ptr, uint16_t number) {
-    uint16_t i;
-    
-    if (number < FLASH_BUFFER_SIZE) {
+    uint16_t i, index;
+
+    if (number < flash_buffer_count) {
+        index = (flash_buffer_tail + number) % FLASH_BUFFER_SIZE;
         for (i = 0; i < LOGGING_BUFFER_RAW_32_LEN; i++) {
-            logging_buffer_ptr->raw_uint32[i] = flash_buffer[number].raw_uint32[i];
+            logging_buffer_ptr->raw_uint32[i] = flash_buffer[index].raw_uint32[i];
         }
         return 1;
     } else {
@@ -54,13 +95,418 @@ int8_t flash_get_flash_logging_data(logging_buffer_t *logging_buffer_ptr, uint16
     }
 }
 
-void flash_clear_data(void) {
-    uint16_t i, j;
-    
-    for (i = 0; i < FLASH_BUFFER_SIZE; i++) {
-        for (j = 0; j < LOGGING_BUFFER_RAW_32_LEN; j++) {
-            flash_buffer[i].raw_uint32[j] = 0;
+void flash_release_data(uint16_t number) {
+    if (number > flash_buffer_count) {
+        number = flash_buffer_count;
+    }
+    flash_buffer_tail = (flash_buffer_tail + number) % FLASH_BUFFER_SIZE;
+    flash_buffer_count -= number;
+}
+
+#elif defined(FLASH_STORE_NOR) || defined(FLASH_STORE_RTSP)
+
+// A sector is what the part erases at once
+#if defined(FLASH_STORE_NOR)
+#define FLASH_PART_SECTOR_SIZE  FLASH_NOR_SECTOR_SIZE
+#define FLASH_PART_SECTOR_COUNT FLASH_NOR_SECTOR_COUNT
+#define flash_part_init         flash_nor_init
+#define flash_part_read         flash_nor_read
+#define flash_part_program      flash_nor_program
+#define flash_part_erase        flash_nor_erase_sector
+#define flash_part_is_busy      flash_nor_is_busy
+#else
+#define FLASH_PART_SECTOR_SIZE  FLASH_RTSP_PAGE_SIZE
+#define FLASH_PART_SECTOR_COUNT FLASH_RTSP_PAGE_COUNT
+#define flash_part_init         flash_rtsp_init
+#define flash_part_read         flash_rtsp_read
+#define flash_part_program      flash_rtsp_program
+#define flash_part_erase        flash_rtsp_erase_page
+#define flash_part_is_busy      flash_rtsp_is_busy
+#endif
+
+// The records are written one after the other into slots, a header in front
+// of each. Slots do not cross sectors, 14 slots of 276 bytes fit a 4 kB NOR
+// sector and 7 a 2 kB page of program flash. Header, record and slot are
+// whole double words of program flash, so none is programmed twice. All
+// sectors are used in turn, so they wear evenly. A sector is
+// erased as soon as all its records are released, what is not erased after
+// a reset is saved again. That is at most one sector of records that were
+// already on the card, plus the sectors the erasing had not caught up with.
+typedef struct {
+    uint16_t magic;
+    uint16_t crc;               // Over seq and the record
+    uint32_t seq;               // Counts every record ever stored
+} flash_record_header_t;
+
+#define FLASH_RECORD_MAGIC      0x5246  // "FR"
+#define FLASH_SLOT_SIZE         (sizeof(flash_record_header_t) + LOGGING_BUFFER_RAW_8_LEN)
+#define FLASH_SLOTS_PER_SECTOR  (uint16_t)(FLASH_PART_SECTOR_SIZE / FLASH_SLOT_SIZE)
+#define FLASH_SLOT_COUNT        (uint16_t)(FLASH_PART_SECTOR_COUNT * FLASH_SLOTS_PER_SECTOR)
+#define FLASH_SECTOR_COUNT      (uint16_t)FLASH_PART_SECTOR_COUNT
+
+// Bytes per read while checking a sector or record
+#define FLASH_CHUNK_SIZE        32
+
+static bool flash_ok = false;
+// Slot of the oldest record that is not released, and the number of records
+// from there on. The next record goes into slot tail + count.
+static uint16_t flash_tail = 0;
+static uint16_t flash_count = 0;
+static uint32_t flash_seq = 0;
+// Released sectors from here up to the sector of the tail still have to be
+// erased
+static uint16_t flash_erase_sector = 0;
+// The sector the next record goes into is erased
+static bool flash_head_ready = false;
+// A record that arrived while the part was erasing, it waits in ram until
+// flash_handler() or the next store programs it
+static logging_buffer_t flash_pending;
+static bool flash_pending_valid = false;
+
+static uint32_t flash_slot_address(uint16_t slot) {
+    return (uint32_t)(slot / FLASH_SLOTS_PER_SECTOR) * FLASH_PART_SECTOR_SIZE +
+           (uint32_t)(slot % FLASH_SLOTS_PER_SECTOR) * FLASH_SLOT_SIZE;
+}
+
+static uint16_t flash_head(void) {
+    return (flash_tail + flash_count) % FLASH_SLOT_COUNT;
+}
+
+// Whether a record that is not released is in the sector
+static bool flash_sector_in_use(uint16_t sector) {
+    uint16_t first = sector * FLASH_SLOTS_PER_SECTOR;
+
+    if (flash_count == 0) {
+        return false;
+    }
+    return (first + FLASH_SLOT_COUNT - flash_tail) % FLASH_SLOT_COUNT < flash_count ||
+           (flash_tail + FLASH_SLOT_COUNT - first) % FLASH_SLOT_COUNT < FLASH_SLOTS_PER_SECTOR;
+}
+
+static bool flash_is_blank(uint8_t *data, uint16_t length) {
+    uint16_t i;
+
+    for (i = 0; i < length; i++) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool flash_sector_is_blank(uint16_t sector) {
+    uint8_t chunk[FLASH_CHUNK_SIZE];
+    uint32_t address = (uint32_t)sector * FLASH_PART_SECTOR_SIZE;
+    uint16_t offset;
+
+    for (offset = 0; offset < FLASH_PART_SECTOR_SIZE; offset += FLASH_CHUNK_SIZE) {
+        flash_part_read(address + offset, chunk, FLASH_CHUNK_SIZE);
+        if (!flash_is_blank(chunk, FLASH_CHUNK_SIZE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint16_t flash_record_crc(flash_record_header_t *header, uint8_t *record) {
+    uint16_t crc = utl_update_crc(UTL_CRC_INIT, (uint8_t *)&header->seq, sizeof(header->seq));
+
+    return utl_update_crc(crc, record, LOGGING_BUFFER_RAW_8_LEN);
+}
+
+// Reads the header of a slot and checks the record behind it without a
+// record sized buffer. Returns false for a damaged or empty slot.
+static bool flash_slot_check(uint16_t slot, flash_record_header_t *header) {
+    uint8_t chunk[FLASH_CHUNK_SIZE];
+    uint32_t address = flash_slot_address(slot);
+    uint16_t offset, length;
+    uint16_t crc;
+
+    flash_part_read(address, (uint8_t *)header, sizeof(*header));
+    if (header->magic != FLASH_RECORD_MAGIC) {
+        return false;
+    }
+
+    crc = utl_update_crc(UTL_CRC_INIT, (uint8_t *)&header->seq, sizeof(header->seq));
+    address += sizeof(*header);
+    for (offset = 0; offset < LOGGING_BUFFER_RAW_8_LEN; offset += length) {
+        length = LOGGING_BUFFER_RAW_8_LEN - offset;
+        if (length > FLASH_CHUNK_SIZE) {
+            length = FLASH_CHUNK_SIZE;
+        }
+        flash_part_read(address + offset, chunk, length);
+        crc = utl_update_crc(crc, chunk, length);
+    }
+    return crc == header->crc;
+}
+
+// Sequence number of the first intact record in a sector
+static bool flash_sector_first_seq(uint16_t sector, uint32_t *seq) {
+    flash_record_header_t header;
+    uint16_t slot = sector * FLASH_SLOTS_PER_SECTOR;
+    uint16_t i;
+
+    for (i = 0; i < FLASH_SLOTS_PER_SECTOR; i++) {
+        if (flash_slot_check(slot + i, &header)) {
+            *seq = header.seq;
+            return true;
+        }
+        // Slots are filled in order, so the rest is empty as well
+        if (flash_is_blank((uint8_t *)&header, sizeof(header))) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Finds the records that were not released before the reset. The sector with
+// the highest sequence number was written last, going back from there the
+// numbers go down until an erased sector or an older round.
+static void flash_recover(void) {
+    flash_record_header_t header;
+    uint16_t sector, head_sector = 0, tail_sector, used, i;
+    uint32_t seq, first_seq = 0;
+    bool found = false;
+
+    flash_tail = 0;
+    flash_count = 0;
+    flash_seq = 0;
+    flash_erase_sector = 0;
+    flash_head_ready = false;
+    flash_pending_valid = false;
+
+    for (sector = 0; sector < FLASH_SECTOR_COUNT; sector++) {
+        if (flash_sector_first_seq(sector, &seq) && (!found || seq > first_seq)) {
+            head_sector = sector;
+            first_seq = seq;
+            found = true;
+        }
+    }
+    if (!found) {
+        return;
+    }
+
+    // Slots in use in the last sector, damaged ones included. The last intact
+    // record has the highest number.
+    used = 0;
+    for (i = 0; i < FLASH_SLOTS_PER_SECTOR; i++) {
+        if (flash_slot_check(head_sector * FLASH_SLOTS_PER_SECTOR + i, &header)) {
+            flash_seq = header.seq + 1;
+        } else if (flash_is_blank((uint8_t *)&header, sizeof(header))) {
+            break;
+        }
+        used = i + 1;
+    }
+
+    tail_sector = head_sector;
+    for (i = 1; i < FLASH_SECTOR_COUNT; i++) {
+        sector = (tail_sector + FLASH_SECTOR_COUNT - 1) % FLASH_SECTOR_COUNT;
+        if (!flash_sector_first_seq(sector, &seq) || seq >= first_seq) {
+            break;
+        }
+        tail_sector = sector;
+        first_seq = seq;
+    }
+
+    flash_tail = tail_sector * FLASH_SLOTS_PER_SECTOR;
+    flash_count = (i - 1) * FLASH_SLOTS_PER_SECTOR + used;
+    flash_erase_sector = tail_sector;
+    // Part of the last sector is still free
+    flash_head_ready = used < FLASH_SLOTS_PER_SECTOR;
+}
+
+void flash_init(void) {
+    flash_ok = flash_part_init();
+    if (!flash_ok) {
+        debugprint_string("Staging flash not found\r\n");
+        return;
+    }
+    flash_recover();
+
+    debugprint_string("Staging flash records: ");
+    debugprint_uint(flash_count);
+    debugprint_string("\r\n");
+}
+
+// Erases the sector the next record goes into, it has no records that still
+// have to be saved
+static void flash_prepare_head_sector(void) {
+    uint16_t sector = flash_head() / FLASH_SLOTS_PER_SECTOR;
+
+    // The records are released but flash_handler() did not get to it yet
+    if (sector == flash_erase_sector && sector != flash_tail / FLASH_SLOTS_PER_SECTOR) {
+        flash_erase_sector = (flash_erase_sector + 1) % FLASH_SECTOR_COUNT;
+        flash_part_erase((uint32_t)sector * FLASH_PART_SECTOR_SIZE);
+    } else if (!flash_sector_is_blank(sector)) {
+        // Left over from before a reset
+        flash_part_erase((uint32_t)sector * FLASH_PART_SECTOR_SIZE);
+    }
+}
+
+// Programs a record into the head slot, its sector is erased
+static void flash_program_record(logging_buffer_t *logging_buffer_ptr) {
+    flash_record_header_t header;
+    uint32_t address;
+    uint16_t head = flash_head();
+
+    header.magic = FLASH_RECORD_MAGIC;
+    header.seq = flash_seq;
+    header.crc = flash_record_crc(&header, logging_buffer_ptr->raw_uint8);
+    // Header first, a reset halfway leaves a slot that fails the crc instead
+    // of one that looks empty
+    address = flash_slot_address(head);
+    flash_part_program(address, (uint8_t *)&header, sizeof(header));
+    flash_part_program(address + sizeof(header), logging_buffer_ptr->raw_uint8, LOGGING_BUFFER_RAW_8_LEN);
+
+    flash_seq++;
+    flash_count++;
+    if ((head + 1) % FLASH_SLOTS_PER_SECTOR == 0) {
+        flash_head_ready = false;
+    }
+    if (flash_count > flash_stats.records_max) {
+        flash_stats.records_max = flash_count;
+    }
+}
+
+void flash_handler(void) {
+    if (!flash_ok || flash_part_is_busy()) {
+        return;
+    }
+
+    // The waiting record first, one step per loop
+    if (flash_pending_valid) {
+        if (!flash_head_ready) {
+            flash_prepare_head_sector();
+            flash_head_ready = true;
+        } else {
+            flash_program_record(&flash_pending);
+            flash_pending_valid = false;
+        }
+        return;
+    }
+
+    // One sector at a time, see flash_is_busy()
+    if (flash_erase_sector != flash_tail / FLASH_SLOTS_PER_SECTOR) {
+        flash_part_erase((uint32_t)flash_erase_sector * FLASH_PART_SECTOR_SIZE);
+        flash_erase_sector = (flash_erase_sector + 1) % FLASH_SECTOR_COUNT;
+    }
+}
+
+uint16_t flash_store_logging_data(logging_buffer_t *logging_buffer_ptr) {
+    uint16_t i, head, overwritten = 0;
+
+    if (!flash_ok) {
+        flash_stats.dropped++;
+        return 0;
+    }
+    // Only when an erase takes longer than the time between two records,
+    // this waits for it
+    if (flash_pending_valid) {
+        if (!flash_head_ready) {
+            flash_prepare_head_sector();
+            flash_head_ready = true;
+        }
+        flash_program_record(&flash_pending);
+        flash_pending_valid = false;
+    }
+
+    head = flash_head();
+    if (head % FLASH_SLOTS_PER_SECTOR == 0 && !flash_head_ready) {
+        if (flash_sector_in_use(head / FLASH_SLOTS_PER_SECTOR)) {
+#if defined(FLASH_OVERRUN_OVERWRITE_OLDEST)
+            // The head caught up with the tail, a sector is erased at once
+            // so the rest of the sector of the tail goes
+            overwritten = FLASH_SLOTS_PER_SECTOR - flash_tail % FLASH_SLOTS_PER_SECTOR;
+            if (overwritten > flash_count) {
+                overwritten = flash_count;
+            }
+            flash_release_data(overwritten);
+            flash_stats.overwritten += overwritten;
+#else
+            flash_stats.dropped++;
+            return 0;
+#endif
+        }
+        // Otherwise flash_handler() erases it
+        if (!flash_part_is_busy()) {
+            flash_prepare_head_sector();
+            flash_head_ready = true;
+        }
+    }
+
+    // Programming would wait for the erase
+    if (!flash_head_ready || flash_part_is_busy()) {
+        for (i = 0; i < LOGGING_BUFFER_RAW_32_LEN; i++) {
+            flash_pending.raw_uint32[i] = logging_buffer_ptr->raw_uint32[i];
         }
+        flash_pending_valid = true;
+        return overwritten;
+    }
+    flash_program_record(logging_buffer_ptr);
+    return overwritten;
+}
+
+uint8_t flash_get_flash_full(void) {
+    uint16_t head = flash_head();
+
+    if (!flash_ok) {
+        return 0;
     }
-    flash_buffer_index = 0;
+    if (head % FLASH_SLOTS_PER_SECTOR == 0 && !flash_head_ready &&
+            flash_sector_in_use(head / FLASH_SLOTS_PER_SECTOR)) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+uint16_t flash_get_flash_number_of_data(void) {
+    return flash_count;
+}
+
+bool flash_is_busy(void) {
+    return flash_ok && flash_part_is_busy();
+}
+
+uint16_t flash_get_flash_size(void) {
+    // The store is full when the head reaches the sector of the tail
+    return FLASH_SLOT_COUNT - FLASH_SLOTS_PER_SECTOR;
+}
+
+int8_t flash_get_flash_logging_data(logging_buffer_t *logging_buffer_ptr, uint16_t number) {
+    flash_record_header_t header;
+    uint32_t address;
+
+    if (!flash_ok || number >= flash_count) {
+        return 0;
+    }
+
+    address = flash_slot_address((flash_tail + number) % FLASH_SLOT_COUNT);
+    flash_part_read(address, (uint8_t *)&header, sizeof(header));
+    flash_part_read(address + sizeof(header), logging_buffer_ptr->raw_uint8, LOGGING_BUFFER_RAW_8_LEN);
+    if (header.magic != FLASH_RECORD_MAGIC || header.crc != flash_record_crc(&header, logging_buffer_ptr->raw_uint8)) {
+        return 0;
+    }
+    return 1;
+}
+
+void flash_release_data(uint16_t number) {
+    if (number > flash_count) {
+        number = flash_count;
+    }
+    flash_tail = (flash_tail + number) % FLASH_SLOT_COUNT;
+    flash_count -= number;
+}
+
+#endif
+
+void flash_release_damaged(void) {
+    if (flash_get_flash_number_of_data() > 0) {
+        flash_stats.damaged++;
+        flash_release_data(1);
+    }
+}
+
+void flash_get_stats(flash_stats_t *stats) {
+    *stats = flash_stats;
 }
@@ -19,7 +19,7 @@
 /* 
  * File:        flash.h
  * Author:      H. Veenstra
- * Comments:    dummy flash implementation
+ * Comments:    staging store for records on their way to the sd card
  */
 
 // This is a guard condition so that contents of this file are not included
@@ -28,18 +28,79 @@
 #define	FLASH_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "device_logger_descriptors.h"
 
+// Uncomment desired staging store, or pass it to the compiler. The current
+// board has no footprint for the NOR part.
+#if !defined(FLASH_STORE_RAM) && !defined(FLASH_STORE_NOR) && !defined(FLASH_STORE_RTSP)
+#define FLASH_STORE_RAM     // 4 records in ram, lost at a reset
+//#define FLASH_STORE_NOR     // SPI NOR flash, see flash_nor.h
+//#define FLASH_STORE_RTSP    // spare program flash pages, see flash_rtsp.h
+#endif
+
+#if defined(FLASH_STORE_RTSP)
+// A page erase stalls the cpu for about 20 ms, main.c only calls
+// flash_handler() while the gps is quiet, right after the can receive
+// buffers were emptied. The 24 buffers last that long up to about 60% load
+// of the 250 kbit/s bus, above it frames are lost during an erase. An erase
+// by flash_store_logging_data(), when the erasing fell behind or a page is
+// left from before a reset, does not wait for the gps: about 15 bytes of the
+// sentence it is sending then are lost.
+#define FLASH_ERASE_STALLS
+#endif
+
+// Uncomment desired overrun policy, for a record that arrives when the store
+// is full
+#define FLASH_OVERRUN_DROP_NEWEST           // The new record is not stored
+//#define FLASH_OVERRUN_OVERWRITE_OLDEST      // The oldest records make room, a sector of them at a time
+
+// Saving starts once this many records wait, about one sd sector of them.
+// Above the high watermark the card does not keep up with the records.
+#define FLASH_LOW_WATERMARK     2
+#define FLASH_HIGH_WATERMARK    (flash_get_flash_size() / 4 * 3)
+
+typedef struct {
+    uint32_t dropped;           // New records not stored, the store was full
+    uint32_t overwritten;       // Oldest records overwritten before they were saved
+    uint16_t records_max;       // Most records waiting at once
+    uint32_t damaged;           // Records released by flash_release_damaged()
+} flash_stats_t;
+
 void flash_init(void);
 
-void flash_store_logging_data(logging_buffer_t *logging_buffer_ptr);
+// Erases the sectors of saved records in the background, call every loop.
+// See FLASH_ERASE_STALLS.
+void flash_handler(void);
+
+// True while the part erases, a read would wait for it. Save records in a
+// later loop then.
+bool flash_is_busy(void);
+
+// Returns the number of oldest records that were overwritten to make room,
+// the numbers of the records that are left go down by as much. A record that
+// arrives while the part erases waits in ram until flash_handler() programs
+// it, a reset before then loses it.
+uint16_t flash_store_logging_data(logging_buffer_t *logging_buffer_ptr);
 
 uint8_t flash_get_flash_full(void);
 
 uint16_t flash_get_flash_number_of_data(void);
 
+// Records that always fit in the store
+uint16_t flash_get_flash_size(void);
+
+// Number 0 is the oldest record. Returns 0 when the record was damaged, for
+// example by a reset while it was programmed.
 int8_t flash_get_flash_logging_data(logging_buffer_t *logging_buffer_ptr, uint16_t number);
 
-void flash_clear_data(void);
+// Releases the oldest records, call once they are on the sd card
+void flash_release_data(uint16_t number);
+
+// Releases the oldest record when flash_get_flash_logging_data() found it
+// damaged, it is counted in flash_stats_t
+void flash_release_damaged(void);
+
+void flash_get_stats(flash_stats_t *stats);
 
 #endif	/* FLASH_H */
@@ -0,0 +1,199 @@
+/*
+ * File:   flash_nor.c
+ * Author: Hylke
+ *
+ * SPI NOR flash on SPI2, through the MLA SPI driver that also runs the sd card
+ */
+
+#include "flash.h"
+
+#if defined(FLASH_STORE_NOR)
+
+#include <xc.h>
+#include <stdint.h>
+#include "flash_nor.h"
+#include "mla_fileio/drv_spi.h"
+#include "mla_fileio/system_defs.h"
+#include "softwaretimer.h"
+
+#define FLASH_NOR_SPI_CHANNEL   2
+// Limit of the board wiring
+#define FLASH_NOR_SPI_CLOCK     15000000ul
+// SCK = Fp / (2 * (BRG + 1)), the fastest clock at or below the limit
+#define FLASH_NOR_SPI_BRG       ((SYS_CLK_FrequencyPeripheralGet() + (2ul * FLASH_NOR_SPI_CLOCK) - 1) / (2ul * FLASH_NOR_SPI_CLOCK) - 1)
+
+//#define FLASH_NOR_PIN_ANSEL_CS
+//#define FLASH_NOR_PIN_ANSEL_MISO
+//#define FLASH_NOR_PIN_ANSEL_MOSI
+//#define FLASH_NOR_PIN_ANSEL_CLK
+
+#define FLASH_NOR_PIN_TRIS_CS   TRISCbits.TRISC6
+#define FLASH_NOR_PIN_TRIS_MISO TRISCbits.TRISC5
+#define FLASH_NOR_PIN_TRIS_MOSI TRISCbits.TRISC4
+#define FLASH_NOR_PIN_TRIS_CLK  TRISCbits.TRISC3
+
+#define FLASH_NOR_PIN_LAT_CS    LATCbits.LATC6
+
+#define FLASH_NOR_PIN_RP_SDI    53
+#define FLASH_NOR_PIN_RP_SDO    _RP52R
+#define FLASH_NOR_PIN_RP_SCK    _RP51R
+
+#define FLASH_NOR_CMD_WRITE_ENABLE      0x06
+#define FLASH_NOR_CMD_READ_STATUS       0x05
+#define FLASH_NOR_CMD_READ              0x03
+#define FLASH_NOR_CMD_PAGE_PROGRAM      0x02
+#define FLASH_NOR_CMD_SECTOR_ERASE      0x20
+#define FLASH_NOR_CMD_JEDEC_ID          0x9F
+#define FLASH_NOR_CMD_RELEASE_POWERDOWN 0xAB
+#define FLASH_NOR_CMD_GLOBAL_UNLOCK     0x98
+
+#define FLASH_NOR_STATUS_BUSY           0x01
+
+// Longer than the worst case sector erase of 400 ms, after that the part is
+// given up on and the record crc shows what went wrong
+#define FLASH_NOR_TIMEOUT_US            500000UL
+
+static void flash_nor_configure_pins(void) {
+#ifdef FLASH_NOR_PIN_ANSEL_CS
+    FLASH_NOR_PIN_ANSEL_CS = 0;
+#endif
+#ifdef FLASH_NOR_PIN_ANSEL_MISO
+    FLASH_NOR_PIN_ANSEL_MISO = 0;
+#endif
+#ifdef FLASH_NOR_PIN_ANSEL_MOSI
+    FLASH_NOR_PIN_ANSEL_MOSI = 0;
+#endif
+#ifdef FLASH_NOR_PIN_ANSEL_CLK
+    FLASH_NOR_PIN_ANSEL_CLK = 0;
+#endif
+
+    FLASH_NOR_PIN_LAT_CS = 1;
+    FLASH_NOR_PIN_TRIS_CS = 0;
+    FLASH_NOR_PIN_TRIS_MISO = 1;
+    FLASH_NOR_PIN_TRIS_MOSI = 0;
+    FLASH_NOR_PIN_TRIS_CLK = 0;
+
+    // PPS unlock
+    __builtin_write_OSCCONL(OSCCON & ~(1<<6));
+    // PPS
+    _SDI2R = FLASH_NOR_PIN_RP_SDI;              // RP53 -> SPI2 SDI
+    FLASH_NOR_PIN_RP_SDO = _RPOUT_SDO2;         // RP52 -> SPI2 SDO
+    FLASH_NOR_PIN_RP_SCK = _RPOUT_SCK2;         // RP51 -> SPI2 SCK
+    // PPS lock
+    __builtin_write_OSCCONL(OSCCON | (1<<6));
+}
+
+static void flash_nor_command(uint8_t command) {
+    FLASH_NOR_PIN_LAT_CS = 0;
+    DRV_SPI_Put(FLASH_NOR_SPI_CHANNEL, command);
+    FLASH_NOR_PIN_LAT_CS = 1;
+}
+
+// Leaves the chip selected for the data that follows
+static void flash_nor_command_address(uint8_t command, uint32_t address) {
+    FLASH_NOR_PIN_LAT_CS = 0;
+    DRV_SPI_Put(FLASH_NOR_SPI_CHANNEL, command);
+    DRV_SPI_Put(FLASH_NOR_SPI_CHANNEL, address >> 16);
+    DRV_SPI_Put(FLASH_NOR_SPI_CHANNEL, address >> 8);
+    DRV_SPI_Put(FLASH_NOR_SPI_CHANNEL, address);
+}
+
+bool flash_nor_is_busy(void) {
+    uint8_t status;
+
+    FLASH_NOR_PIN_LAT_CS = 0;
+    DRV_SPI_Put(FLASH_NOR_SPI_CHANNEL, FLASH_NOR_CMD_READ_STATUS);
+    status = DRV_SPI_Get(FLASH_NOR_SPI_CHANNEL);
+    FLASH_NOR_PIN_LAT_CS = 1;
+    return (status & FLASH_NOR_STATUS_BUSY) != 0;
+}
+
+static void flash_nor_wait(void) {
+    uint32_t start_us = softwaretimer_get_time_us();
+
+    while (flash_nor_is_busy()) {
+        if (softwaretimer_get_time_us() - start_us > FLASH_NOR_TIMEOUT_US) {
+            break;
+        }
+    }
+}
+
+bool flash_nor_init(void) {
+    DRV_SPI_INIT_DATA spi_init_data;
+    uint8_t manufacturer, capacity;
+    uint32_t start_us;
+
+    flash_nor_configure_pins();
+
+    // Same mode as the sd card, the part samples on the rising edge
+    spi_init_data.channel = FLASH_NOR_SPI_CHANNEL;
+    spi_init_data.primaryPrescale = FLASH_NOR_SPI_BRG;
+    spi_init_data.secondaryPrescale = 0;
+    spi_init_data.cke = 0;
+    spi_init_data.spibus_mode = SPI_BUS_MODE_2;
+    spi_init_data.mode = SPI_TRANSFER_MODE_8BIT;
+    DRV_SPI_Initialize(&spi_init_data);
+
+    // The part may still be powered down by a programmer, tRES1 is 3 us
+    flash_nor_command(FLASH_NOR_CMD_RELEASE_POWERDOWN);
+    start_us = softwaretimer_get_time_us();
+    while (softwaretimer_get_time_us() - start_us < 10);
+
+    FLASH_NOR_PIN_LAT_CS = 0;
+    DRV_SPI_Put(FLASH_NOR_SPI_CHANNEL, FLASH_NOR_CMD_JEDEC_ID);
+    manufacturer = DRV_SPI_Get(FLASH_NOR_SPI_CHANNEL);
+    DRV_SPI_Get(FLASH_NOR_SPI_CHANNEL);
+    capacity = DRV_SPI_Get(FLASH_NOR_SPI_CHANNEL);
+    FLASH_NOR_PIN_LAT_CS = 1;
+
+    // An empty footprint reads all zeros or all ones, the capacity is a
+    // power of two
+    if (manufacturer == 0x00 || manufacturer == 0xFF || capacity >= 32 || (1UL << capacity) < FLASH_NOR_SIZE) {
+        return false;
+    }
+
+    // Parts that power up with all blocks protected
+    flash_nor_command(FLASH_NOR_CMD_WRITE_ENABLE);
+    flash_nor_command(FLASH_NOR_CMD_GLOBAL_UNLOCK);
+    flash_nor_wait();
+    return true;
+}
+
+void flash_nor_read(uint32_t address, uint8_t *data, uint16_t length) {
+    flash_nor_wait();
+    flash_nor_command_address(FLASH_NOR_CMD_READ, address);
+    DRV_SPI_GetBuffer(FLASH_NOR_SPI_CHANNEL, data, length);
+    FLASH_NOR_PIN_LAT_CS = 1;
+}
+
+void flash_nor_program(uint32_t address, uint8_t *data, uint16_t length) {
+    uint16_t chunk;
+
+    while (length > 0) {
+        // A page program wraps around within the page, so stop at its end
+        chunk = FLASH_NOR_PAGE_SIZE - (address % FLASH_NOR_PAGE_SIZE);
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        flash_nor_wait();
+        flash_nor_command(FLASH_NOR_CMD_WRITE_ENABLE);
+        flash_nor_command_address(FLASH_NOR_CMD_PAGE_PROGRAM, address);
+        DRV_SPI_PutBuffer(FLASH_NOR_SPI_CHANNEL, data, chunk);
+        FLASH_NOR_PIN_LAT_CS = 1;
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    flash_nor_wait();
+}
+
+void flash_nor_erase_sector(uint32_t address) {
+    flash_nor_wait();
+    flash_nor_command(FLASH_NOR_CMD_WRITE_ENABLE);
+    flash_nor_command_address(FLASH_NOR_CMD_SECTOR_ERASE, address);
+    FLASH_NOR_PIN_LAT_CS = 1;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/* THIS SOFTWARE IS SUPPLIED BY SUNFLARE SOLAR TEAM "AS IS".  NO WARRANTIES, WHETHER
+ * EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+ * WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+ * PARTICULAR PURPOSE, OR ITS INTERACTION WITH SUNFLARE PRODUCTS, COMBINATION
+ * WITH ANY OTHER PRODUCTS, OR USE IN ANY APPLICATION.
+ *
+ * IN NO EVENT WILL SUNFLARE SOLAR TEAM BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+ * INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+ * WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF SUNFLARE SOLAR TEAM HAS
+ * BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE.  TO THE
+ * FULLEST EXTENT ALLOWED BY LAW, SUNFLARE SOLAR TEAM'S TOTAL LIABILITY ON ALL CLAIMS
+ * IN ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF
+ * ANY, THAT YOU HAVE PAID DIRECTLY TO SUNFLARE SOLAR TEAM FOR THIS SOFTWARE.
+ *
+ * SUNFLARE SOLAR TEAM PROVIDES THIS SOFTWARE CONDITIONALLY UPON YOUR ACCEPTANCE OF THESE
+ * TERMS.
+ */
+
+/*
+ * File:        flash_nor.h
+ * Author:      H. Veenstra
+ * Comments:    SPI NOR flash driver for the staging store in flash.c
+ */
+
+// This is a guard condition so that contents of this file are not included
+// more than once.
+#ifndef FLASH_NOR_H
+#define	FLASH_NOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Geometry of the part, a W25Q16JV or any 25-series part with 4 kB sector
+// erase (0x20) and 256 byte page program (0x02). A bigger part works, only
+// the first FLASH_NOR_SIZE bytes are used.
+#define FLASH_NOR_SIZE          (2UL * 1024UL * 1024UL)
+#define FLASH_NOR_SECTOR_SIZE   4096UL
+#define FLASH_NOR_PAGE_SIZE     256UL
+#define FLASH_NOR_SECTOR_COUNT  (FLASH_NOR_SIZE / FLASH_NOR_SECTOR_SIZE)
+
+// Configures the pins and SPI2 and wakes the part. Returns false when no part
+// of at least FLASH_NOR_SIZE answers.
+bool flash_nor_init(void);
+
+// Waits for a program or erase in progress first
+void flash_nor_read(uint32_t address, uint8_t *data, uint16_t length);
+
+// Programs length bytes, split at the page boundaries, and waits until done.
+// Bits can only be cleared, the bytes must be erased before.
+void flash_nor_program(uint32_t address, uint8_t *data, uint16_t length);
+
+// Starts erasing the sector that holds address and returns, the part is
+// busy for typically 45 ms then
+void flash_nor_erase_sector(uint32_t address);
+
+bool flash_nor_is_busy(void);
+
+#endif	/* FLASH_NOR_H */
@@ -0,0 +1,82 @@
+/*
+ * File:   flash_rtsp.c
+ * Author: Hylke
+ *
+ * Staging store in spare pages of program flash, run-time self-programming
+ */
+
+#include "flash.h"
+
+#if defined(FLASH_STORE_RTSP)
+
+#include <xc.h>
+#include <stdint.h>
+#include "flash_rtsp.h"
+
+#define FLASH_RTSP_NVMOP_DOUBLE_WORD    0x4001  // WREN, double word program
+#define FLASH_RTSP_NVMOP_PAGE_ERASE     0x4003  // WREN, page erase
+#define FLASH_RTSP_LATCH_PAGE           0xFA
+
+// Not in the hex file, so programming the application leaves the pages
+// erased. The linker places them and keeps the code out.
+static const uint16_t flash_rtsp_area[FLASH_RTSP_PAGE_COUNT * FLASH_RTSP_PAGE_INSTRUCTIONS]
+    __attribute__((space(prog), aligned(FLASH_RTSP_PAGE_INSTRUCTIONS * 2), noload));
+
+static uint32_t flash_rtsp_base = 0;
+
+static void flash_rtsp_write(uint32_t address, uint16_t nvmop) {
+    NVMADRU = (uint16_t)(address >> 16);
+    NVMADR = (uint16_t)address;
+    NVMCON = nvmop;
+    // Unlock sequence with interrupts disabled, the cpu stalls until done
+    __builtin_write_NVM();
+    while (NVMCONbits.WR);
+    NVMCONbits.WREN = 0;
+}
+
+bool flash_rtsp_init(void) {
+    flash_rtsp_base = __builtin_tbladdress(flash_rtsp_area);
+    return true;
+}
+
+void flash_rtsp_read(uint32_t address, uint8_t *data, uint16_t length) {
+    uint16_t tblpag = TBLPAG;
+    uint32_t pc_address;
+    uint16_t word, i;
+
+    for (i = 0; i < length; i++, address++) {
+        pc_address = flash_rtsp_base + (address & ~1UL);
+        TBLPAG = (uint16_t)(pc_address >> 16);
+        word = __builtin_tblrdl((uint16_t)pc_address);
+        data[i] = (address & 1) ? word >> 8 : word;
+    }
+    TBLPAG = tblpag;
+}
+
+void flash_rtsp_program(uint32_t address, uint8_t *data, uint16_t length) {
+    uint16_t tblpag = TBLPAG;
+    uint16_t i;
+
+    for (i = 0; i + FLASH_RTSP_PROGRAM_SIZE <= length; i += FLASH_RTSP_PROGRAM_SIZE) {
+        // Two instruction words in the write latches, the upper bytes stay
+        // erased
+        TBLPAG = FLASH_RTSP_LATCH_PAGE;
+        __builtin_tblwtl(0, data[i] | ((uint16_t)data[i + 1] << 8));
+        __builtin_tblwth(0, 0xFF);
+        __builtin_tblwtl(2, data[i + 2] | ((uint16_t)data[i + 3] << 8));
+        __builtin_tblwth(2, 0xFF);
+        flash_rtsp_write(flash_rtsp_base + address + i, FLASH_RTSP_NVMOP_DOUBLE_WORD);
+    }
+    TBLPAG = tblpag;
+}
+
+void flash_rtsp_erase_page(uint32_t address) {
+    address -= address % FLASH_RTSP_PAGE_SIZE;
+    flash_rtsp_write(flash_rtsp_base + address, FLASH_RTSP_NVMOP_PAGE_ERASE);
+}
+
+bool flash_rtsp_is_busy(void) {
+    return NVMCONbits.WR;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/* THIS SOFTWARE IS SUPPLIED BY SUNFLARE SOLAR TEAM "AS IS".  NO WARRANTIES, WHETHER
+ * EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+ * WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+ * PARTICULAR PURPOSE, OR ITS INTERACTION WITH SUNFLARE PRODUCTS, COMBINATION
+ * WITH ANY OTHER PRODUCTS, OR USE IN ANY APPLICATION.
+ *
+ * IN NO EVENT WILL SUNFLARE SOLAR TEAM BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+ * INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+ * WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF SUNFLARE SOLAR TEAM HAS
+ * BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE.  TO THE
+ * FULLEST EXTENT ALLOWED BY LAW, SUNFLARE SOLAR TEAM'S TOTAL LIABILITY ON ALL CLAIMS
+ * IN ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF
+ * ANY, THAT YOU HAVE PAID DIRECTLY TO SUNFLARE SOLAR TEAM FOR THIS SOFTWARE.
+ *
+ * SUNFLARE SOLAR TEAM PROVIDES THIS SOFTWARE CONDITIONALLY UPON YOUR ACCEPTANCE OF THESE
+ * TERMS.
+ */
+
+/*
+ * File:        flash_rtsp.h
+ * Author:      H. Veenstra
+ * Comments:    Spare program flash pages for the staging store in flash.c
+ */
+
+// This is a guard condition so that contents of this file are not included
+// more than once.
+#ifndef FLASH_RTSP_H
+#define	FLASH_RTSP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Only the lower 16 bits of every instruction word hold data, so a byte
+// address here is also the offset in program memory. A page of 1024
+// instruction words then holds 2 kB.
+#define FLASH_RTSP_PAGE_INSTRUCTIONS    1024UL
+#define FLASH_RTSP_PAGE_SIZE            (FLASH_RTSP_PAGE_INSTRUCTIONS * 2UL)
+// Pages reserved in program memory by flash_rtsp.c, the linker fails when
+// the application no longer fits next to them. A page is erased about 10.000 times before it
+// wears out, with 7 records per page that is every 112 records here.
+#define FLASH_RTSP_PAGE_COUNT           16UL
+#define FLASH_RTSP_SIZE                 (FLASH_RTSP_PAGE_COUNT * FLASH_RTSP_PAGE_SIZE)
+// Programmed one double word of two instruction words at a time
+#define FLASH_RTSP_PROGRAM_SIZE         4UL
+
+bool flash_rtsp_init(void);
+
+void flash_rtsp_read(uint32_t address, uint8_t *data, uint16_t length);
+
+// Address and length must be multiples of FLASH_RTSP_PROGRAM_SIZE, a double
+// word can only be programmed once after an erase. The cpu stalls for about
+// 50 us per double word.
+void flash_rtsp_program(uint32_t address, uint8_t *data, uint16_t length);
+
+// Erases the page that holds address, the cpu stalls for about 20 ms.
+// Interrupts wait, the peripherals and DMA keep running. That is 19 bytes of
+// the 9600 baud gps of which the uart keeps 4, and 40 frames at full load of
+// the can bus for 24 receive buffers, see FLASH_ERASE_STALLS in flash.h.
+void flash_rtsp_erase_page(uint32_t address);
+
+// The cpu waits for every program and erase, so never busy
+bool flash_rtsp_is_busy(void);
+
+#endif	/* FLASH_RTSP_H */
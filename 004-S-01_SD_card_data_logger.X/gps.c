@@ -13,6 +13,8 @@
 // Defines
 #define GPS_UART_DATA_RATE   115200
 #define GPS_BUFFER_SIZE      1024
+// No byte for this long, the receiver is done with the sentences of a fix
+#define GPS_QUIET_MS         50
 
 #define GPS_PIN_TRIS_TX      TRISCbits.TRISC2
 #define GPS_PIN_TRIS_RX      TRISCbits.TRISC7
@@ -34,6 +36,9 @@ static gps_speed_t gps_speed = {};
 static uint8_t gps_satellites = 0;
 static uint8_t gps_tick = 0;
 static uint32_t gps_time_stamp = 0;
+// Receive buffer position and time when gps_handler() last saw it move
+static uint16_t gps_rx_seen_in = 0;
+static uint32_t gps_rx_seen_us = 0;
 
 // UART 1 interrupt
 void __attribute__((interrupt(auto_psv))) _U1TXInterrupt(void){
@@ -241,6 +246,11 @@ void gps_handler(void) {
     uint32_t value;
     char ch;
 
+    if (gps_rx_buffer.in != gps_rx_seen_in) {
+        gps_rx_seen_in = gps_rx_buffer.in;
+        gps_rx_seen_us = softwaretimer_get_time_us();
+    }
+
     // Skip until the $ sign, indicating new gps data line
     while (gps_rx_buffer.in != gps_rx_buffer.out) {
         if (gps_rx_buffer.data[gps_rx_buffer.out] == '$') {
@@ -384,6 +394,11 @@ void gps_handler(void) {
     
 }
 
+bool gps_is_quiet(void) {
+    return gps_rx_buffer.in == gps_rx_seen_in &&
+           softwaretimer_get_time_us() - gps_rx_seen_us >= GPS_QUIET_MS * 1000UL;
+}
+
 // Get functions
 gps_time_t get_gps_time(void) {
     return gps_time;
@@ -33,6 +33,7 @@
 
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct {
     uint8_t sec;
@@ -61,6 +62,10 @@ void gps_init(void);
 
 void gps_handler(void);
 
+// True when the receiver sent nothing for a while, it is between the
+// sentences of two fixes. Seen by gps_handler(), so call that every loop.
+bool gps_is_quiet(void);
+
 // Variable get
 gps_time_t get_gps_time(void);
 gps_coordinates_t get_gps_coordinates(void);
@@ -26,14 +26,22 @@
 int main(void) {
     int8_t one_sec_timer = SOFTWARETIMER_NONE, log_timer = SOFTWARETIMER_NONE;
     uint32_t time_since_boot_sec = 0;
-    uint16_t i;
+    // Records given to the sd logger that are still in flash, and given ones
+    // that were overwritten in flash before a sync put them on the card
+    uint16_t save_index = 0, save_overwritten = 0, overwritten, release;
+    uint32_t records_synced = 0;
+    bool file_task_busy;
     enum {
-        DATA_GATHERING,
-        DATA_SAVING
-    } logging_mode = DATA_GATHERING;
+        SAVING_IDLE,
+        SAVING_RECORDS
+    } saving_state = SAVING_IDLE;
     can_msg_t rx_msg;
     logging_buffer_t logging_buffer;
     gps_time_t time;
+    // Gps day of the current log file, 0 before the gps has a date
+    uint8_t log_day = 0;
+    sd_logger_stats_t sd_stats;
+    flash_stats_t flash_stats;
     
     LED_PIN_TRIS_RED = 0;
     LED_PIN_TRIS_GREEN = 0;
@@ -76,55 +84,124 @@ int main(void) {
     
     while (1) {
         
-        switch (logging_mode) {
-            case DATA_GATHERING:
-                gps_handler();
-                // Transmit CAN bus messages
-                can_transmit_process();
-                
-                // Check if a can bus message has been received
-                if (can_receive_message(&rx_msg)) {
-                    // Decode and collect data in local ram
-                    device_logger_decode_and_collect_can_message(rx_msg);
-                }
-                
-                // Check if data is ready to be stored
-                if (softwaretimer_get_expired(log_timer)) {
-                    LED_PIN_LAT_GREEN = !LED_PIN_LAT_GREEN;
-                    device_logger_increase_time_since_boot(DATA_LOGGING_RATE_MS);
-                    get_device_logger_collected_data(&logging_buffer);
-                    device_logger_clear_data();
-                    
-                    // Store to flash
-                    flash_store_logging_data(&logging_buffer);
+        gps_handler();
+        // Mount the sd card when it is inserted, give it up when it is removed
+        sd_logger_media_task();
+        // Rotate, open and sync the log file, in a step of its own
+        file_task_busy = sd_logger_file_task();
+        // Transmit CAN bus messages
+        can_transmit_process();
+        
+        // Empty the receive FIFO, saving below only takes short slices so
+        // this runs often enough to keep up with the bus
+        while (can_receive_message(&rx_msg)) {
+            // Decode and collect data in local ram
+            device_logger_decode_and_collect_can_message(rx_msg);
+        }
+        
+        // Erase the staging flash that is saved
+#if defined(FLASH_ERASE_STALLS)
+        // With the can receive buffers just emptied and no gps sentence
+        // arriving
+        if (gps_is_quiet()) {
+            flash_handler();
+        }
+#else
+        flash_handler();
+#endif
+        
+        // Check if data is ready to be stored
+        if (softwaretimer_get_expired(log_timer)) {
+            LED_PIN_LAT_GREEN = !LED_PIN_LAT_GREEN;
+            device_logger_increase_time_since_boot(DATA_LOGGING_RATE_MS);
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+            sd_logger_collect_timing();
+#endif
+            get_device_logger_collected_data(&logging_buffer);
+            device_logger_clear_data();
+            
+            // Store to flash, when it is full the overrun policy in flash.h
+            // decides which record goes
+            overwritten = flash_store_logging_data(&logging_buffer);
+            if (overwritten > save_index) {
+                overwritten = save_index;
+            }
+            save_index -= overwritten;
+            save_overwritten += overwritten;
+        }
+        
+        // Save to sd one step per loop, so gathering never waits for more
+        // than one record. Records that arrive meanwhile join the batch.
+        switch (saving_state) {
+            case SAVING_IDLE:
+                // Check if we need to store to sd. Without a card the
+                // records stay in flash, the red led shows the card is missing
+                // or does not keep up.
+                if (!sd_logger_is_ready() || flash_get_flash_number_of_data() >= FLASH_HIGH_WATERMARK) {
+                    LED_PIN_LAT_RED = 1;
+                } else {
+                    LED_PIN_LAT_RED = 0;
                 }
-                
-                // Check if we need to store to sd
-                if (flash_get_flash_full()) {
-                    logging_mode = DATA_SAVING;
+                if (sd_logger_is_ready() && flash_get_flash_number_of_data() - save_index >= FLASH_LOW_WATERMARK) {
+                    saving_state = SAVING_RECORDS;
                 }
                 break;
                 
-            case DATA_SAVING:
-                // Save data
-                LED_PIN_LAT_RED = 1;
-                LED_PIN_LAT_GREEN = 0;
-                for (i = 0; i < flash_get_flash_number_of_data(); i++) {
-                    flash_get_flash_logging_data(&logging_buffer, i);
-                    sd_logger_store_logging_buffer(&logging_buffer);
-                    // Kick the dog
-                    ClrWdt();
+            case SAVING_RECORDS:
+                if (!sd_logger_is_ready()) {
+                    saving_state = SAVING_IDLE;
+                } else if (file_task_busy || flash_is_busy()) {
+                    // The card had its step for this loop, or reading the
+                    // record would wait for a flash erase
+                } else if (save_index < flash_get_flash_number_of_data()) {
+                    if (flash_get_flash_logging_data(&logging_buffer, save_index)) {
+                        sd_logger_store_logging_buffer(&logging_buffer);
+                        save_index++;
+                    } else if (save_index == 0) {
+                        // Damaged, e.g. by a reset while it was programmed
+                        flash_release_damaged();
+                    } else {
+                        // Sync the records before the damaged one, so it is
+                        // the oldest once they are released
+                        sd_logger_sync();
+                        saving_state = SAVING_IDLE;
+                    }
+                } else {
+                    // The sync policy of the sd logger releases the records,
+                    // unless they fill the flash before it is due
+                    if (save_index >= FLASH_HIGH_WATERMARK) {
+                        sd_logger_sync();
+                    }
+                    saving_state = SAVING_IDLE;
                 }
-                flash_clear_data();
-                logging_mode = DATA_GATHERING;
-                LED_PIN_LAT_RED = 0;
                 break;
                 
             default:
-                logging_mode = DATA_GATHERING;
+                saving_state = SAVING_IDLE;
                 break;
         }
         
+        // Only release records that a sync put on the card for sure
+        release = sd_logger_get_records_synced() - records_synced;
+        records_synced += release;
+        if (release > save_overwritten) {
+            release -= save_overwritten;
+            save_overwritten = 0;
+        } else {
+            save_overwritten -= release;
+            release = 0;
+        }
+        if (release > 0) {
+            flash_release_data(release);
+            save_index -= release;
+        }
+        if (!sd_logger_is_ready()) {
+            // Card removed or failed, the records that are not released are
+            // saved again once a card is mounted
+            save_index = 0;
+            save_overwritten = 0;
+        }
+        
         // Triggers every 1 sec
         if (softwaretimer_get_expired(one_sec_timer) == 1) {
             time_since_boot_sec++;
@@ -140,19 +217,57 @@ int main(void) {
             debugprint_string(":");
             debugprint_uint(time.sec);
             debugprint_string("\r\n");
+            
+            // Every day of racing is a session of its own, in its own files
+            if (time.day != 0 && time.day != log_day) {
+                if (log_day != 0 && sd_logger_is_ready()) {
+                    sd_logger_rotate();
+                }
+                log_day = time.day;
+            }
+            
+            // Sd card write cost every minute
+            if ((time_since_boot_sec % 60) == 0) {
+                sd_logger_get_stats(&sd_stats);
+                debugprint_string("SD sectors read: ");
+                debugprint_uint(sd_stats.sector_reads);
+                debugprint_string(" written: ");
+                debugprint_uint(sd_stats.sector_writes);
+                debugprint_string(" syncs: ");
+                debugprint_uint(sd_stats.syncs);
+                debugprint_string(" sync writes: ");
+                debugprint_uint(sd_stats.sync_sector_writes);
+                debugprint_string(" max: ");
+                debugprint_uint(sd_stats.sync_sector_writes_max);
+                debugprint_string(" corrupt records: ");
+                debugprint_uint(sd_stats.corrupt_records);
+                debugprint_string(" cards lost: ");
+                debugprint_uint(sd_stats.cards_lost);
+                debugprint_string("\r\n");
+                flash_get_stats(&flash_stats);
+                debugprint_string("Flash records max: ");
+                debugprint_uint(flash_stats.records_max);
+                debugprint_string(" dropped: ");
+                debugprint_uint(flash_stats.dropped);
+                debugprint_string(" overwritten: ");
+                debugprint_uint(flash_stats.overwritten);
+                debugprint_string(" damaged: ");
+                debugprint_uint(flash_stats.damaged);
+                debugprint_string("\r\n");
+                sd_logger_print_timing();
+            }
         }
         
         // Kick the dog
         ClrWdt();
         
-        // Modes:
-        // 1 normal
+        // Every loop:
         //      Receive messages and store in ram
         //      Store in flash every x ms
-        // 2 saving
-        //      Get messages from flash
-        //      Store on sd card
-        //      Clear all data
+        //      Erase flash that is saved
+        // When the flash holds a few records and a card is mounted, one step per loop:
+        //      Get a message from flash and store it on sd card
+        //      Sync the card and release the saved records
     }
     return 1; 
 }
@@ -52,7 +52,7 @@ SUBSTITUTE GOODS, TECHNOLOGY, SERVICES, OR ANY CLAIMS BY THIRD PARTIES
 
 /**Enable SPI channel 2
 */
-//#define DRV_SPI_CONFIG_CHANNEL_2_ENABLE
+#define DRV_SPI_CONFIG_CHANNEL_2_ENABLE
 
 /** Enable SPI channel 3
 */
@@ -41,21 +41,21 @@ FILEIO_TimestampGet timestampGet;
 #if defined (__XC16__) || defined (__XC32__)
     #if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
         uint8_t __attribute__ ((aligned(4)))   gDataBuffer[FILEIO_CONFIG_MEDIA_SECTOR_SIZE];      // The global data sector buffer
-        uint8_t __attribute__ ((aligned(4)))   gFATBuffer[FILEIO_CONFIG_MEDIA_SECTOR_SIZE];       // The global FAT sector buffer
+        uint8_t __attribute__ ((aligned(4)))   gFATBuffer[FILEIO_CONFIG_FAT_CACHE_SECTORS][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];       // The global FAT sector cache
         FILEIO_BUFFER_STATUS bufferStatus;                                          // Status of the buffer contents (and buffer ownership)
     #else
         uint8_t __attribute__ ((aligned(4)))   gDataBuffer[FILEIO_CONFIG_MAX_DRIVES][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];     // The global data sector buffer
-        uint8_t __attribute__ ((aligned(4)))   gFATBuffer[FILEIO_CONFIG_MAX_DRIVES][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];      // The global FAT sector buffer
+        uint8_t __attribute__ ((aligned(4)))   gFATBuffer[FILEIO_CONFIG_MAX_DRIVES][FILEIO_CONFIG_FAT_CACHE_SECTORS][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];      // The global FAT sector cache
         FILEIO_BUFFER_STATUS bufferStatus[FILEIO_CONFIG_MAX_DRIVES];
     #endif
 #else
     #if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
         uint8_t gDataBuffer[FILEIO_CONFIG_MEDIA_SECTOR_SIZE];      // The global data sector buffer
-        uint8_t gFATBuffer[FILEIO_CONFIG_MEDIA_SECTOR_SIZE];       // The global FAT sector buffer
+        uint8_t gFATBuffer[FILEIO_CONFIG_FAT_CACHE_SECTORS][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];       // The global FAT sector cache
         FILEIO_BUFFER_STATUS bufferStatus;                                          // Status of the buffer contents (and buffer ownership)
     #else
         uint8_t gDataBuffer[FILEIO_CONFIG_MAX_DRIVES][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];     // The global data sector buffer
-        uint8_t gFATBuffer[FILEIO_CONFIG_MAX_DRIVES][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];      // The global FAT sector buffer
+        uint8_t gFATBuffer[FILEIO_CONFIG_MAX_DRIVES][FILEIO_CONFIG_FAT_CACHE_SECTORS][FILEIO_CONFIG_MEDIA_SECTOR_SIZE];      // The global FAT sector cache
         FILEIO_BUFFER_STATUS bufferStatus[FILEIO_CONFIG_MAX_DRIVES];
     #endif
 #endif
@@ -83,25 +83,23 @@ int FILEIO_Initialize (void)
         gDriveSlotOpen[i] = true;
 #if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
         gDriveArray[i].dataBuffer = &gDataBuffer[0];
-        gDriveArray[i].fatBuffer = &gFATBuffer[0];
+        gDriveArray[i].fatBuffer = &gFATBuffer[0][0];
         gDriveArray[i].bufferStatusPtr = &bufferStatus;
 #else
         gDriveArray[i].dataBuffer = &gDataBuffer[i][0];
-        gDriveArray[i].fatBuffer = &gFATBuffer[i][0];
+        gDriveArray[i].fatBuffer = &gFATBuffer[i][0][0];
         gDriveArray[i].bufferStatusPtr = &bufferStatus[i];
         bufferStatus[i].flags.dataBufferNeedsWrite = false;
-        bufferStatus[i].flags.fatBufferNeedsWrite = false;
         bufferStatus[i].dataBufferCachedSector = 0xFFFFFFFF;
-        bufferStatus[i].fatBufferCachedSector = 0xFFFFFFFF;
+        FILEIO_FATCacheInvalidate (&bufferStatus[i]);
 #endif
     }
 
 #if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
     bufferStatus.driveOwner = NULL;
     bufferStatus.flags.dataBufferNeedsWrite = false;
-    bufferStatus.flags.fatBufferNeedsWrite = false;
     bufferStatus.dataBufferCachedSector = 0xFFFFFFFF;
-    bufferStatus.fatBufferCachedSector = 0xFFFFFFFF;
+    FILEIO_FATCacheInvalidate (&bufferStatus);
 #endif
     
     globalParameters.currentWorkingDirectory.drive = 0;
@@ -148,6 +146,18 @@ FILEIO_FILE_SYSTEM_TYPE FILEIO_FileSystemTypeGet (char driveId)
     return drive->type;
 }
 
+uint32_t FILEIO_ClusterSizeGet (char driveId)
+{
+    FILEIO_DRIVE * drive = FILEIO_CharToDrive (driveId);
+
+    if (drive == NULL)
+    {
+        return 0;
+    }
+
+    return (uint32_t)drive->sectorsPerCluster * drive->sectorSize;
+}
+
 FILEIO_ERROR_TYPE FILEIO_DriveMount (char driveId, const FILEIO_DRIVE_CONFIG * driveConfig, void * mediaParameters)
 {
     FILEIO_ERROR_TYPE error = FILEIO_ERROR_NONE;
@@ -187,9 +197,8 @@ FILEIO_ERROR_TYPE FILEIO_DriveMount (char driveId, const FILEIO_DRIVE_CONFIG * d
     }
 #else
     bufferStatus[i].flags.dataBufferNeedsWrite = false;
-    bufferStatus[i].flags.fatBufferNeedsWrite = false;
     bufferStatus[i].dataBufferCachedSector = 0xFFFFFFFF;
-    bufferStatus[i].fatBufferCachedSector = 0xFFFFFFFF;
+    FILEIO_FATCacheInvalidate (&bufferStatus[i]);
 #endif
 
 #if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
@@ -233,6 +242,13 @@ FILEIO_ERROR_TYPE FILEIO_DriveMount (char driveId, const FILEIO_DRIVE_CONFIG * d
         }
     }
 
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+    if (error == FILEIO_ERROR_NONE)
+    {
+        FILEIO_FSInfoLoad (drive);
+    }
+#endif
+
     if (error == FILEIO_ERROR_NONE)
     {
         // If this is the first drive we're mounting, set its root as the current working directory
@@ -520,11 +536,27 @@ FILEIO_ERROR_TYPE FILEIO_LoadBootSector (FILEIO_DRIVE * drive)
                             memcpy(&drive->firstRootCluster, &drive->dataBuffer[BSI_ROOTCLUS], 4 );
                         #endif
                         drive->firstDataSector = drive->firstRootSector + rootDirectorySectors;
+                        #if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+                        {
+                            uint16_t fsInfo;
+
+                            #ifdef __XC8__
+                                fsInfo = ptrBootSector->biosParameterBlock.fat32.fileSystemInformation;
+                            #else
+                                memcpy(&fsInfo, &drive->dataBuffer[BSI_FSINFO], 2);
+                            #endif
+                            // 0 and 0xFFFF mean there is no FSInfo sector
+                            drive->fsInfoSector = ((fsInfo == 0) || (fsInfo == 0xFFFF)) ? 0 : drive->firstPartitionSector + fsInfo;
+                        }
+                        #endif
                     }
                     else
                     {
                         drive->firstRootCluster = 0;
                         drive->firstDataSector = drive->firstRootSector + (drive->rootDirectoryEntryCount >> 4);
+                        #if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+                        drive->fsInfoSector = 0;
+                        #endif
                     }
 
                     if(bytesPerSector > FILEIO_CONFIG_MEDIA_SECTOR_SIZE)
@@ -611,6 +643,9 @@ int FILEIO_DriveUnmount (const char driveId)
     }
     else
     {
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+        FILEIO_FSInfoWrite (drive);
+#endif
 #if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
     #if !defined (FILEIO_CONFIG_WRITE_DISABLE)
         if (drive->bufferStatusPtr->driveOwner == drive)
@@ -913,6 +948,7 @@ int FILEIO_Open (FILEIO_OBJECT * filePtr, const char * fileName, uint16_t mode)
         {
             filePtr->flags.writeEnabled = false;
         }
+        filePtr->flags.preallocated = false;
 #endif
 
         if ((mode & FILEIO_OPEN_APPEND) == FILEIO_OPEN_APPEND)
@@ -1368,6 +1404,12 @@ FILEIO_ERROR_TYPE FILEIO_FindShortFileName (FILEIO_DIRECTORY * directory, FILEIO
                 directory->drive->error = FILEIO_ERROR_BAD_CACHE_READ;
                 return error;
             }
+            else if (entry == NULL)
+            {
+                // The data buffer could not be flushed or the directory sector could not be read
+                directory->drive->error = error;
+                return error;
+            }
 
             if(entry->attributes == FILEIO_ATTRIBUTE_VOLUME && (attributes == FILEIO_ATTRIBUTE_VOLUME))
             {
@@ -1701,40 +1743,256 @@ FILEIO_ERROR_TYPE FILEIO_ClusterAllocate (FILEIO_DRIVE * drive, uint32_t * clust
 }
 #endif
 
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+void FILEIO_FSInfoLoad (FILEIO_DRIVE * drive)
+{
+    uint32_t value;
+
+    drive->freeClusterCount = FILEIO_FSINFO_UNKNOWN;
+    drive->fsInfoNeedsWrite = false;
+
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+    // Every group may have free clusters until a search has read all of it
+    memset (drive->freeMap, 0xFF, FILEIO_CONFIG_FREE_MAP_SIZE);
+    drive->freeMapScanStart = 0;
+    drive->freeMapScanEnd = 0;
+    drive->freeMapShift = 0;
+    if (drive->type != FILEIO_FILE_SYSTEM_TYPE_FAT12)
+    {
+        // A group is at least one FAT sector, FAT12 entries can cross sectors so it has no map
+        for (value = drive->sectorSize >> ((drive->type == FILEIO_FILE_SYSTEM_TYPE_FAT32) ? 2 : 1); value > 1; value >>= 1)
+        {
+            drive->freeMapShift++;
+        }
+        while (((drive->partitionClusterCount + 1) >> drive->freeMapShift) >= (FILEIO_CONFIG_FREE_MAP_SIZE * 8ul))
+        {
+            drive->freeMapShift++;
+        }
+    }
+#endif
+
+    if (drive->fsInfoSector == 0)
+    {
+        return;
+    }
+
+    if ( (*drive->driveConfig->funcSectorRead) (drive->mediaParameters, drive->fsInfoSector, drive->dataBuffer) != true)
+    {
+        drive->bufferStatusPtr->dataBufferCachedSector = 0xFFFFFFFF;
+        drive->fsInfoSector = 0;
+        return;
+    }
+    drive->bufferStatusPtr->dataBufferCachedSector = drive->fsInfoSector;
+
+    // Don't use or overwrite a sector that isn't a FSInfo sector
+    memcpy (&value, &drive->dataBuffer[FSI_LEADSIG], 4);
+    if (value != FILEIO_FSINFO_LEADSIG)
+    {
+        drive->fsInfoSector = 0;
+        return;
+    }
+    memcpy (&value, &drive->dataBuffer[FSI_STRUCSIG], 4);
+    if (value != FILEIO_FSINFO_STRUCSIG)
+    {
+        drive->fsInfoSector = 0;
+        return;
+    }
+    memcpy (&value, &drive->dataBuffer[FSI_TRAILSIG], 4);
+    if (value != FILEIO_FSINFO_TRAILSIG)
+    {
+        drive->fsInfoSector = 0;
+        return;
+    }
+
+    // Both values are hints, ignore them when they are out of range
+    memcpy (&value, &drive->dataBuffer[FSI_FREE_COUNT], 4);
+    if (value <= drive->partitionClusterCount)
+    {
+        drive->freeClusterCount = value;
+    }
+    memcpy (&value, &drive->dataBuffer[FSI_NXT_FREE], 4);
+    if ((value >= 2) && (value < (drive->partitionClusterCount + 2)))
+    {
+        // Start searching for free clusters behind the last one allocated, instead of at the top of the FAT
+        drive->currentCluster = value;
+    }
+}
+
+int FILEIO_FSInfoWrite (FILEIO_DRIVE * drive)
+{
+    uint32_t value;
+
+    if ((drive->fsInfoSector == 0) || !drive->fsInfoNeedsWrite)
+    {
+        return FILEIO_RESULT_SUCCESS;
+    }
+
+#if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
+    if (FILEIO_GetSingleBuffer (drive) != FILEIO_RESULT_SUCCESS)
+    {
+        return FILEIO_RESULT_FAILURE;
+    }
+#endif
+
+    if (!FILEIO_FlushBuffer (drive, FILEIO_BUFFER_DATA))
+    {
+        return FILEIO_RESULT_FAILURE;
+    }
+
+    // The rest of the sector is reserved and zero, so it doesn't have to be read first
+    memset (drive->dataBuffer, 0x00, drive->sectorSize);
+    value = FILEIO_FSINFO_LEADSIG;
+    memcpy (&drive->dataBuffer[FSI_LEADSIG], &value, 4);
+    value = FILEIO_FSINFO_STRUCSIG;
+    memcpy (&drive->dataBuffer[FSI_STRUCSIG], &value, 4);
+    memcpy (&drive->dataBuffer[FSI_FREE_COUNT], &drive->freeClusterCount, 4);
+    memcpy (&drive->dataBuffer[FSI_NXT_FREE], &drive->currentCluster, 4);
+    value = FILEIO_FSINFO_TRAILSIG;
+    memcpy (&drive->dataBuffer[FSI_TRAILSIG], &value, 4);
+
+    if ( (*drive->driveConfig->funcSectorWrite) (drive->mediaParameters, drive->fsInfoSector, drive->dataBuffer, false) != true)
+    {
+        drive->bufferStatusPtr->dataBufferCachedSector = 0xFFFFFFFF;
+        return FILEIO_RESULT_FAILURE;
+    }
+    drive->bufferStatusPtr->dataBufferCachedSector = drive->fsInfoSector;
+    drive->fsInfoNeedsWrite = false;
+
+    return FILEIO_RESULT_SUCCESS;
+}
+#endif
+
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE) && !defined (FILEIO_CONFIG_WRITE_DISABLE)
+// Returns the first cluster from cluster on that is in a group that may have free clusters, or limit
+static uint32_t FILEIO_FreeMapNext (FILEIO_DRIVE * drive, uint32_t cluster, uint32_t limit)
+{
+    uint32_t group;
+
+    if (drive->freeMapShift == 0)
+    {
+        return cluster;
+    }
+
+    while (cluster < limit)
+    {
+        group = cluster >> drive->freeMapShift;
+        if (drive->freeMap[group >> 3] & (1 << (group & 7)))
+        {
+            return cluster;
+        }
+        cluster = (group + 1) << drive->freeMapShift;
+    }
+
+    return limit;
+}
+
+// Notes a cluster a search found in use.  Consecutive ones are collected, also over several searches, and a group
+// is marked full when they span all of it.
+static void FILEIO_FreeMapUsed (FILEIO_DRIVE * drive, uint32_t cluster)
+{
+    uint32_t group, groupStart;
+
+    if (drive->freeMapShift == 0)
+    {
+        return;
+    }
+
+    if (cluster != drive->freeMapScanEnd)
+    {
+        drive->freeMapScanStart = cluster;
+    }
+    drive->freeMapScanEnd = cluster + 1;
+
+    // Check if this was the last cluster of its group
+    if (((drive->freeMapScanEnd & ((1ul << drive->freeMapShift) - 1)) == 0) || (drive->freeMapScanEnd == (drive->partitionClusterCount + 2)))
+    {
+        group = cluster >> drive->freeMapShift;
+        groupStart = group << drive->freeMapShift;
+        // Entries 0 and 1 aren't clusters
+        if (groupStart < 2)
+        {
+            groupStart = 2;
+        }
+        if (drive->freeMapScanStart <= groupStart)
+        {
+            drive->freeMap[group >> 3] &= ~(1 << (group & 7));
+        }
+    }
+}
+
+// Notes a cluster that was freed
+static void FILEIO_FreeMapFreed (FILEIO_DRIVE * drive, uint32_t cluster)
+{
+    uint32_t group;
+
+    if (drive->freeMapShift == 0)
+    {
+        return;
+    }
+
+    group = cluster >> drive->freeMapShift;
+    drive->freeMap[group >> 3] |= 1 << (group & 7);
+    // The used clusters collected so far may include this one
+    drive->freeMapScanEnd = 0;
+}
+#endif
+
 #if !defined (FILEIO_CONFIG_WRITE_DISABLE)
 uint32_t FILEIO_FindEmptyCluster (FILEIO_DRIVE * drive)
 {
     uint32_t cluster = 0x0;
-    uint32_t currentCluster, endClusterLimit, clusterFailValue;
+    uint32_t currentCluster, clusterFailValue;
     uint32_t baseCluster = drive->currentCluster;
+    uint32_t endCluster = drive->partitionClusterCount + 2;
+    uint32_t limit = endCluster;
 
     /* Settings based on FAT type */
     switch (drive->type)
     {
         case FILEIO_FILE_SYSTEM_TYPE_FAT32:
-            endClusterLimit = FILEIO_CLUSTER_VALUE_FAT32_END;
             clusterFailValue = FILEIO_CLUSTER_VALUE_FAT32_FAIL;
             break;
         case FILEIO_FILE_SYSTEM_TYPE_FAT12:
-            endClusterLimit = FILEIO_CLUSTER_VALUE_FAT12_END;
-            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
-            break;
         case FILEIO_FILE_SYSTEM_TYPE_FAT16:
         default:
-            endClusterLimit = FILEIO_CLUSTER_VALUE_FAT16_END;
             clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
             break;
     }
 
     // just in case
-    if(baseCluster < 2)
+    if ((baseCluster < 2) || (baseCluster >= endCluster))
         baseCluster = 2;
 
     currentCluster = baseCluster;
 
-    // sequentially scan through the FAT looking for an empty cluster
-    while(currentCluster)
+    // sequentially scan through the FAT looking for an empty cluster,
+    // from baseCluster to the end of the FAT, then from the top up to baseCluster
+    while(1)
     {
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+        // skip the groups of FAT sectors without empty clusters
+        currentCluster = FILEIO_FreeMapNext (drive, currentCluster, limit);
+#endif
+
+        if (currentCluster >= limit)
+        {
+            // check if full circle done, disk full
+            if ((limit != endCluster) || (baseCluster == 2))
+            {
+                if (drive->freeClusterCount != 0)
+                {
+                    drive->freeClusterCount = 0;
+                    drive->fsInfoNeedsWrite = true;
+                }
+                currentCluster = 0;
+                break;
+            }
+            // re-start from top
+            limit = baseCluster;
+            currentCluster = 2;
+            continue;
+        }
+
         // look at its value
         if ((cluster = FILEIO_FATRead(drive, currentCluster)) == clusterFailValue)
         {
@@ -1746,25 +2004,107 @@ uint32_t FILEIO_FindEmptyCluster (FILEIO_DRIVE * drive)
         if (cluster == FILEIO_CLUSTER_VALUE_EMPTY)
             break;
 
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+        FILEIO_FreeMapUsed (drive, currentCluster);
+#endif
+
         currentCluster++;    // check next cluster in FAT
+    }  // scanning for an empty cluster
+    
+    drive->currentCluster = currentCluster;
+    
+    return(currentCluster);
+}
+#endif
 
-        // check if reached last cluster in FAT, re-start from top
-        if ((cluster == endClusterLimit) || (currentCluster >= (drive->partitionClusterCount + 2)))
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+uint32_t FILEIO_FindEmptyClusterRun (FILEIO_DRIVE * drive, uint32_t start, uint32_t count)
+{
+    uint32_t cluster, value, clusterFailValue;
+    uint32_t runStart = 0, runLength = 0;
+    uint32_t endCluster = drive->partitionClusterCount + 2;
+    uint32_t limit = endCluster;
+    bool wrapped = false;
+
+    switch (drive->type)
+    {
+        case FILEIO_FILE_SYSTEM_TYPE_FAT32:
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT32_FAIL;
+            break;
+        case FILEIO_FILE_SYSTEM_TYPE_FAT12:
+        case FILEIO_FILE_SYSTEM_TYPE_FAT16:
+        default:
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
+            break;
+    }
+
+    if ((start < 2) || (start >= endCluster))
+    {
+        start = 2;
+    }
+
+    // Scan from start to the end of the FAT, then from the top up to start.
+    // A run can't wrap around the end of the FAT.
+    cluster = start;
+    while (1)
+    {
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+        // Skip the groups of FAT sectors without empty clusters, a run can't span them
+        value = FILEIO_FreeMapNext (drive, cluster, limit);
+        if (value != cluster)
         {
-            currentCluster = 2;
+            cluster = value;
+            runLength = 0;
         }
+#endif
 
-        // check if full circle done, disk full
-        if ( currentCluster == baseCluster)
+        if (cluster >= limit)
         {
-            currentCluster = 0;
-            break;
+            if (wrapped || (start == 2))
+            {
+                return 0;
+            }
+            wrapped = true;
+            cluster = 2;
+            runLength = 0;
+            // Overlap with the first pass so runs crossing start are found
+            limit = start + count - 1;
+            if (limit > endCluster)
+            {
+                limit = endCluster;
+            }
+            continue;
         }
-    }  // scanning for an empty cluster
-    
-    drive->currentCluster = currentCluster;
-    
-    return(currentCluster);
+
+        if ((value = FILEIO_FATRead (drive, cluster)) == clusterFailValue)
+        {
+            return 0;
+        }
+
+        if (value == FILEIO_CLUSTER_VALUE_EMPTY)
+        {
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+            // Free clusters of a run that is too short stay free
+            drive->freeMapScanEnd = 0;
+#endif
+            if (runLength == 0)
+            {
+                runStart = cluster;
+            }
+            if (++runLength == count)
+            {
+                return runStart;
+            }
+        }
+        else
+        {
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+            FILEIO_FreeMapUsed (drive, cluster);
+#endif
+            runLength = 0;
+        }
+        cluster++;
+    }
 }
 #endif
 
@@ -1909,50 +2249,146 @@ FILEIO_ERROR_TYPE FILEIO_ForceRecache (FILEIO_DRIVE * disk)
     return FILEIO_ERROR_NONE;
 }
 
+void FILEIO_FATCacheInvalidate (FILEIO_BUFFER_STATUS * status)
+{
+    uint8_t i;
+
+    for (i = 0; i < FILEIO_CONFIG_FAT_CACHE_SECTORS; i++)
+    {
+        status->fatBufferCachedSector[i] = 0xFFFFFFFF;
+        status->fatBufferOrder[i] = i;
+    }
+    status->flags.fatBufferNeedsWrite = 0;
+}
+
+// Makes a FAT cache entry the most recently used one. With a single entry
+// it always is.
+static void FILEIO_FATCacheTouch (FILEIO_BUFFER_STATUS * status, uint8_t position)
+{
+#if FILEIO_CONFIG_FAT_CACHE_SECTORS > 1
+    uint8_t entry = status->fatBufferOrder[position];
+
+    for (; position < FILEIO_CONFIG_FAT_CACHE_SECTORS - 1; position++)
+    {
+        status->fatBufferOrder[position] = status->fatBufferOrder[position + 1];
+    }
+    status->fatBufferOrder[FILEIO_CONFIG_FAT_CACHE_SECTORS - 1] = entry;
+#else
+    (void)status;
+    (void)position;
+#endif
+}
+
 #if !defined (FILEIO_CONFIG_WRITE_DISABLE)
-bool FILEIO_FlushBuffer (FILEIO_DRIVE * disk, FILEIO_BUFFER_ID bufferId)
+// Writes a modified FAT cache entry to every copy of the FAT
+static bool FILEIO_FATSectorWriteBack (FILEIO_DRIVE * disk, uint8_t entry)
 {
-#if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
-    disk = disk->bufferStatusPtr->driveOwner;
+    FILEIO_BUFFER_STATUS * status = disk->bufferStatusPtr;
+    uint32_t sector;
+    uint8_t i;
 
-    if (disk == NULL)
+    if ((status->flags.fatBufferNeedsWrite & (1 << entry)) == 0)
     {
         return true;
     }
-#endif
-    switch (bufferId)
+
+    sector = status->fatBufferCachedSector[entry];
+    for (i = 0; i < disk->fatCopyCount; i++, sector += disk->fatSectorCount)
     {
-        case FILEIO_BUFFER_DATA:
-            if (disk->bufferStatusPtr->flags.dataBufferNeedsWrite)
-            {
-                if (!(*disk->driveConfig->funcSectorWrite)(disk->mediaParameters, disk->bufferStatusPtr->dataBufferCachedSector, disk->dataBuffer, false) )
-                {
-                    return false;
-                }
-                disk->bufferStatusPtr->flags.dataBufferNeedsWrite = false;
-            }
-            break;
-        case FILEIO_BUFFER_FAT:
-            if (disk->bufferStatusPtr->flags.fatBufferNeedsWrite)
-            {
-                uint32_t sector = disk->bufferStatusPtr->fatBufferCachedSector;
-                uint8_t i;
-                for (i = 0; i < disk->fatCopyCount; i++, sector += disk->fatSectorCount)
-                {
-                    if (! (*disk->driveConfig->funcSectorWrite)(disk->mediaParameters, sector, disk->fatBuffer, false) )
-                    {
-                        return false;
-                    }
-                }
-                disk->bufferStatusPtr->flags.fatBufferNeedsWrite = false;
-            }
-            break;
+        if (! (*disk->driveConfig->funcSectorWrite)(disk->mediaParameters, sector, disk->fatBuffer + (uint16_t)entry * FILEIO_CONFIG_MEDIA_SECTOR_SIZE, false) )
+        {
+            return false;
+        }
     }
+    status->flags.fatBufferNeedsWrite &= ~(1 << entry);
     return true;
 }
+
+// Marks the most recently used FAT cache entry, the one last returned by
+// FILEIO_FATSectorGet, as modified
+static void FILEIO_FATSectorModified (FILEIO_DRIVE * disk)
+{
+    FILEIO_BUFFER_STATUS * status = disk->bufferStatusPtr;
+
+    status->flags.fatBufferNeedsWrite |= 1 << status->fatBufferOrder[FILEIO_CONFIG_FAT_CACHE_SECTORS - 1];
+}
 #endif
 
-bool FILEIO_ShortFileNameCompare (uint8_t * fileName1, uint8_t * fileName2, uint8_t mode)
+uint8_t * FILEIO_FATSectorGet (FILEIO_DRIVE * disk, uint32_t sector)
+{
+    FILEIO_BUFFER_STATUS * status = disk->bufferStatusPtr;
+    uint8_t i, entry;
+
+    for (i = 0; i < FILEIO_CONFIG_FAT_CACHE_SECTORS; i++)
+    {
+        entry = status->fatBufferOrder[i];
+        if (status->fatBufferCachedSector[entry] == sector)
+        {
+            FILEIO_FATCacheTouch (status, i);
+            return disk->fatBuffer + (uint16_t)entry * FILEIO_CONFIG_MEDIA_SECTOR_SIZE;
+        }
+    }
+
+    // Replace the least recently used entry, write it back first if it was modified
+    entry = status->fatBufferOrder[0];
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+    if (!FILEIO_FATSectorWriteBack (disk, entry))
+    {
+        return NULL;
+    }
+#endif
+    if (!(*disk->driveConfig->funcSectorRead) (disk->mediaParameters, sector, disk->fatBuffer + (uint16_t)entry * FILEIO_CONFIG_MEDIA_SECTOR_SIZE))
+    {
+        status->fatBufferCachedSector[entry] = 0xFFFFFFFF;
+        return NULL;
+    }
+    status->fatBufferCachedSector[entry] = sector;
+    FILEIO_FATCacheTouch (status, 0);
+    return disk->fatBuffer + (uint16_t)entry * FILEIO_CONFIG_MEDIA_SECTOR_SIZE;
+}
+
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+bool FILEIO_FlushBuffer (FILEIO_DRIVE * disk, FILEIO_BUFFER_ID bufferId)
+{
+#if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
+    disk = disk->bufferStatusPtr->driveOwner;
+
+    if (disk == NULL)
+    {
+        return true;
+    }
+#endif
+    switch (bufferId)
+    {
+        case FILEIO_BUFFER_DATA:
+            if (disk->bufferStatusPtr->flags.dataBufferNeedsWrite)
+            {
+                if (!(*disk->driveConfig->funcSectorWrite)(disk->mediaParameters, disk->bufferStatusPtr->dataBufferCachedSector, disk->dataBuffer, false) )
+                {
+                    return false;
+                }
+                disk->bufferStatusPtr->flags.dataBufferNeedsWrite = false;
+            }
+            break;
+        case FILEIO_BUFFER_FAT:
+            {
+                uint8_t i;
+                // Oldest first, so sectors reach the media in the order they were last changed
+                for (i = 0; i < FILEIO_CONFIG_FAT_CACHE_SECTORS; i++)
+                {
+                    if (!FILEIO_FATSectorWriteBack (disk, disk->bufferStatusPtr->fatBufferOrder[i]))
+                    {
+                        return false;
+                    }
+                }
+            }
+            break;
+    }
+    return true;
+}
+#endif
+
+bool FILEIO_ShortFileNameCompare (uint8_t * fileName1, uint8_t * fileName2, uint8_t mode)
 {
     if ((mode & FILEIO_SEARCH_PARTIAL_STRING_SEARCH) == FILEIO_SEARCH_PARTIAL_STRING_SEARCH)
     {
@@ -2027,6 +2463,7 @@ uint32_t FILEIO_ClusterToSector(FILEIO_DRIVE * disk, uint32_t cluster)
 uint32_t FILEIO_FATRead (FILEIO_DRIVE * disk, uint32_t currentCluster)
 {
     uint8_t q;
+    uint8_t * fatBuffer;
     uint32_t p, sector_address;
     uint32_t c = 0, d, ClusterFailValue,LastClusterLimit;   // ClusterEntries
 
@@ -2058,107 +2495,48 @@ uint32_t FILEIO_FATRead (FILEIO_DRIVE * disk, uint32_t currentCluster)
     sector_address = disk->firstFatSector + (p >> ((disk->sectorSize >> 9) + 8));     //p/(disk->sectorSize) = p>>((disk->sectorSize >> 9)+8)
     p &= disk->sectorSize - 1;                 // Restrict 'p' within the FATbuffer size
 
-    // Check if the appropriate FAT sector is already loaded
-    if (disk->bufferStatusPtr->fatBufferCachedSector == sector_address)
+    // Get the FAT sector from the cache
+    fatBuffer = FILEIO_FATSectorGet (disk, sector_address);
+    if (fatBuffer == NULL)
     {
-        if (disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT32)
+        return ClusterFailValue;
+    }
+
+    if (disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT32)
+    {
+        memcpy(&c, &fatBuffer[p], 4);
+    }
+    else
+    {
+        if(disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT16)
         {
-            memcpy(&c, &disk->fatBuffer[p], 4);
+            memcpy(&c, &fatBuffer[p], 2 );
         }
-        else
+        else if(disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT12)
         {
-            if(disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT16)
+            c = *(fatBuffer + p);
+            if (q)
             {
-                memcpy(&c, &disk->fatBuffer[p], 2 );
+                c >>= 4;
             }
-            else if(disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT12)
+            // Check if the MSB is across the sector boundary
+            p = (p +1) & (disk->sectorSize-1);
+            if (p == 0)
             {
-                c = *(disk->fatBuffer + p);
-                if (q)
+                fatBuffer = FILEIO_FATSectorGet (disk, sector_address + 1);
+                if (fatBuffer == NULL)
                 {
-                    c >>= 4;
-                }
-                // Check if the MSB is across the sector boundary
-                p = (p +1) & (disk->sectorSize-1);
-                if (p == 0)
-                {
-                    // Start by writing the sector we just worked on to the card
-                    // if we need to
-#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
-                    if (!FILEIO_FlushBuffer (disk, FILEIO_BUFFER_FAT))
-                    {
-                        return ClusterFailValue;
-                    }
-#endif
-                    if (!(*disk->driveConfig->funcSectorRead) (disk->mediaParameters, sector_address+1, disk->fatBuffer))
-                    {
-                        disk->bufferStatusPtr->fatBufferCachedSector = 0xFFFFFFFF;
-                        return ClusterFailValue;
-                    }
-                    else
-                    {
-                        disk->bufferStatusPtr->fatBufferCachedSector = sector_address + 1;
-                    }
-                }
-                d = *(disk->fatBuffer + p);
-                if (q)
-                {
-                    c += (d <<4);
-                }
-                else
-                {
-                    c += ((d & 0x0F)<<8);
+                    return ClusterFailValue;
                 }
             }
-        }
-    }
-    else
-    {
-        // If there's a currently open FAT sector,
-        // write it back before reading into the buffer
-#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
-        if (!FILEIO_FlushBuffer (disk, FILEIO_BUFFER_FAT))
-        {
-            return ClusterFailValue;
-        }
-#endif
-        if (!(*disk->driveConfig->funcSectorRead) (disk->mediaParameters, sector_address, disk->fatBuffer))
-        {
-            disk->bufferStatusPtr->fatBufferCachedSector = 0xFFFFFFFF;  // Note: It is Sector not Cluster.
-            return ClusterFailValue;
-        }
-        else
-        {
-            disk->bufferStatusPtr->fatBufferCachedSector = sector_address;
-
-            if (disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT32)
+            d = *(fatBuffer + p);
+            if (q)
             {
-                memcpy(&c, &disk->fatBuffer[p], 4);
+                c += (d <<4);
             }
             else
             {
-                if(disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT16)
-                {
-                    memcpy(&c, &disk->fatBuffer[p], 2);
-                }
-                else if (disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT12)
-                {
-                    c = *(disk->fatBuffer + p);
-                    if (q)
-                    {
-                        c >>= 4;
-                    }
-                    p = (p +1) & (disk->sectorSize-1);
-                    d = *(disk->fatBuffer + p);
-                    if (q)
-                    {
-                        c += (d <<4);
-                    }
-                    else
-                    {
-                        c += ((d & 0x0F)<<8);
-                    }
-                }
+                c += ((d & 0x0F)<<8);
             }
         }
     }
@@ -2329,8 +2707,8 @@ FILEIO_ERROR_TYPE FILEIO_EraseClusterChain (uint32_t cluster, FILEIO_DRIVE * dis
 uint32_t FILEIO_FATWrite (FILEIO_DRIVE *disk, uint32_t currentCluster, uint32_t value, uint8_t forceWrite)
 {
     uint8_t q, c;
-    uint32_t p, l, clusterFailValue;
-    FILEIO_BUFFER_STATUS * statusPtr = disk->bufferStatusPtr;
+    uint32_t p, l, clusterFailValue, oldValue;
+    uint8_t * fatBuffer;
 
     if ((disk->type != FILEIO_FILE_SYSTEM_TYPE_FAT32) && (disk->type != FILEIO_FILE_SYSTEM_TYPE_FAT16) && (disk->type != FILEIO_FILE_SYSTEM_TYPE_FAT12))
     {
@@ -2380,45 +2758,48 @@ uint32_t FILEIO_FATWrite (FILEIO_DRIVE *disk, uint32_t currentCluster, uint32_t
     l = disk->firstFatSector + (p / disk->sectorSize);     //
     p &= disk->sectorSize - 1;                 // Restrict 'p' within the FATbuffer size
 
-    if (disk->bufferStatusPtr->fatBufferCachedSector != l)
+    fatBuffer = FILEIO_FATSectorGet (disk, l);
+    if (fatBuffer == NULL)
     {
-        // If we are loading a new sector then write
-        // the current one to the card if we need to
-        if (!FILEIO_FlushBuffer (disk, FILEIO_BUFFER_FAT))
-        {
-            return clusterFailValue;
-        }
-
-        // Load the new sector
-        if (!(*disk->driveConfig->funcSectorRead) (disk->mediaParameters, l, disk->fatBuffer))
-        {
-            statusPtr->fatBufferCachedSector = 0xFFFFFFFF;
-            return clusterFailValue;
-        }
-        else
-        {
-            statusPtr->fatBufferCachedSector = l;
-        }
+        return clusterFailValue;
     }
 
     if (disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT32)  // Refer page 16 of FAT requirement.
     {
-        *(disk->fatBuffer + p) = ((value & 0x000000ff));         // lsb,1st uint8_t of cluster value
-        *(disk->fatBuffer + p+1) = ((value & 0x0000ff00) >> 8);
-        *(disk->fatBuffer + p+2) = ((value & 0x00ff0000) >> 16);
-        *(disk->fatBuffer + p+3) = ((value & 0x0f000000) >> 24);   // the MSB nibble is supposed to be "0" in FAT32. So mask it.
+        // Keep the free cluster count of the FSInfo sector up to date
+        oldValue = ((uint32_t)*(fatBuffer + p)) | ((uint32_t)*(fatBuffer + p+1) << 8) | ((uint32_t)*(fatBuffer + p+2) << 16) | ((uint32_t)(*(fatBuffer + p+3) & 0x0f) << 24);
+        if ((oldValue == FILEIO_CLUSTER_VALUE_EMPTY) != ((value & 0x0fffffff) == FILEIO_CLUSTER_VALUE_EMPTY))
+        {
+            if (disk->freeClusterCount != FILEIO_FSINFO_UNKNOWN)
+            {
+                if (oldValue == FILEIO_CLUSTER_VALUE_EMPTY)
+                {
+                    disk->freeClusterCount--;
+                }
+                else
+                {
+                    disk->freeClusterCount++;
+                }
+            }
+            disk->fsInfoNeedsWrite = true;
+        }
+
+        *(fatBuffer + p) = ((value & 0x000000ff));         // lsb,1st uint8_t of cluster value
+        *(fatBuffer + p+1) = ((value & 0x0000ff00) >> 8);
+        *(fatBuffer + p+2) = ((value & 0x00ff0000) >> 16);
+        *(fatBuffer + p+3) = ((value & 0x0f000000) >> 24);   // the MSB nibble is supposed to be "0" in FAT32. So mask it.
     }
     else
     {
         if (disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT16)
         {
-            *(disk->fatBuffer+ p) = value;            //lsB
-            *(disk->fatBuffer + p+1) = ((value&0x0000ff00) >> 8);    // msB
+            *(fatBuffer+ p) = value;            //lsB
+            *(fatBuffer + p+1) = ((value&0x0000ff00) >> 8);    // msB
         }
         else if (disk->type == FILEIO_FILE_SYSTEM_TYPE_FAT12)
         {
             // Get the current uint8_t from the FAT
-            c = *(disk->fatBuffer + p);
+            c = *(fatBuffer + p);
             if (q)
             {
                 c = ((value & 0x0F) << 4) | ( c & 0x0F);
@@ -2428,33 +2809,25 @@ uint32_t FILEIO_FATWrite (FILEIO_DRIVE *disk, uint32_t currentCluster, uint32_t
                 c = (value & 0xFF);
             }
             // Write in those bits
-            *(disk->fatBuffer + p) = c;
+            *(fatBuffer + p) = c;
 
             // FAT12 entries can cross sector boundaries
             // Check if we need to load a new sector
             p = (p +1) & (disk->sectorSize-1);
             if (p == 0)
             {
-                // call this function to update the FAT on the card
-                if (!FILEIO_FlushBuffer (disk, FILEIO_BUFFER_FAT))
-                {
-                    return clusterFailValue;
-                }
+                FILEIO_FATSectorModified (disk);
 
                 // Load the next sector
-                if (!(*disk->driveConfig->funcSectorRead) (disk->mediaParameters, l +1, disk->fatBuffer))
+                fatBuffer = FILEIO_FATSectorGet (disk, l + 1);
+                if (fatBuffer == NULL)
                 {
-                    statusPtr->fatBufferCachedSector = 0xFFFFFFFF;
                     return clusterFailValue;
                 }
-                else
-                {
-                    statusPtr->fatBufferCachedSector = l + 1;
-                }
             }
 
             // Get the second uint8_t of the table entry
-            c = *(disk->fatBuffer + p);
+            c = *(fatBuffer + p);
             if (q)
             {
                 c = (value >> 4);
@@ -2463,10 +2836,17 @@ uint32_t FILEIO_FATWrite (FILEIO_DRIVE *disk, uint32_t currentCluster, uint32_t
             {
                 c = ((value >> 8) & 0x0F) | (c & 0xF0);
             }
-            *(disk->fatBuffer + p) = c;
+            *(fatBuffer + p) = c;
         }
     }
-    statusPtr->flags.fatBufferNeedsWrite = true;
+    FILEIO_FATSectorModified (disk);
+
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+    if (value == FILEIO_CLUSTER_VALUE_EMPTY)
+    {
+        FILEIO_FreeMapFreed (disk, currentCluster);
+    }
+#endif
 
     return 0;
 }
@@ -2537,7 +2917,27 @@ int FILEIO_Close(FILEIO_OBJECT * filePtr)
     int result = FILEIO_RESULT_SUCCESS;
 
 #if !defined (FILEIO_CONFIG_WRITE_DISABLE)
-    result = FILEIO_Flush (filePtr);
+    if (filePtr->flags.writeEnabled && filePtr->flags.preallocated)
+    {
+        // Give back the reserved clusters that were not used
+        FILEIO_ERROR_TYPE error = FILEIO_ClusterChainTrim (filePtr);
+        if (error != FILEIO_ERROR_NONE)
+        {
+            ((FILEIO_DRIVE *)filePtr->disk)->error = error;
+            result = FILEIO_RESULT_FAILURE;
+        }
+        filePtr->flags.preallocated = false;
+    }
+
+    if (FILEIO_Flush (filePtr) != FILEIO_RESULT_SUCCESS)
+    {
+        result = FILEIO_RESULT_FAILURE;
+    }
+    else if (filePtr->flags.writeEnabled && (FILEIO_FSInfoWrite (filePtr->disk) != FILEIO_RESULT_SUCCESS))
+    {
+        ((FILEIO_DRIVE *)filePtr->disk)->error = FILEIO_ERROR_WRITE;
+        result = FILEIO_RESULT_FAILURE;
+    }
 #endif
 
     filePtr->flags.readEnabled = false;
@@ -2546,6 +2946,319 @@ int FILEIO_Close(FILEIO_OBJECT * filePtr)
     return result;
 }
 
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+int FILEIO_Preallocate (FILEIO_OBJECT * filePtr, uint32_t size)
+{
+    FILEIO_DRIVE * disk = filePtr->disk;
+    FILEIO_ERROR_TYPE error = FILEIO_ERROR_NONE;
+    uint32_t clusterSize, clusterCount, needed;
+    uint32_t lastCluster, nextCluster, runStart, cluster;
+    uint32_t eofValue, clusterFailValue;
+
+    if (!filePtr->flags.writeEnabled)
+    {
+        disk->error = FILEIO_ERROR_READ_ONLY;
+        return FILEIO_RESULT_FAILURE;
+    }
+
+#if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
+    if (FILEIO_GetSingleBuffer (disk) != FILEIO_RESULT_SUCCESS)
+    {
+        return FILEIO_RESULT_FAILURE;
+    }
+#endif
+
+    if ((*disk->driveConfig->funcWriteProtectGet)(disk->mediaParameters))
+    {
+        disk->error = FILEIO_ERROR_WRITE_PROTECTED;
+        return FILEIO_RESULT_FAILURE;
+    }
+
+    switch (disk->type)
+    {
+        case FILEIO_FILE_SYSTEM_TYPE_FAT32:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT32_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT32_FAIL;
+            break;
+        case FILEIO_FILE_SYSTEM_TYPE_FAT12:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT12_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
+            break;
+        case FILEIO_FILE_SYSTEM_TYPE_FAT16:
+        default:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT16_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
+            break;
+    }
+
+    clusterSize = (uint32_t)disk->sectorSize * disk->sectorsPerCluster;
+    needed = (size + clusterSize - 1) / clusterSize;
+
+    // Find the end of the current chain
+    clusterCount = 1;
+    lastCluster = filePtr->firstCluster;
+    while ((nextCluster = FILEIO_FATRead (disk, lastCluster)) < eofValue)
+    {
+        if ((nextCluster < 2) || (nextCluster >= (disk->partitionClusterCount + 2)))
+        {
+            disk->error = FILEIO_ERROR_INVALID_CLUSTER;
+            return FILEIO_RESULT_FAILURE;
+        }
+        lastCluster = nextCluster;
+        clusterCount++;
+    }
+    if (nextCluster == clusterFailValue)
+    {
+        disk->error = FILEIO_ERROR_BAD_SECTOR_READ;
+        return FILEIO_RESULT_FAILURE;
+    }
+
+    filePtr->flags.preallocated = true;
+
+    if (clusterCount >= needed)
+    {
+        disk->error = FILEIO_ERROR_NONE;
+        return FILEIO_RESULT_SUCCESS;
+    }
+    needed -= clusterCount;
+
+    // Prefer the clusters directly behind the file so the chain stays contiguous
+    runStart = FILEIO_FindEmptyClusterRun (disk, lastCluster + 1, needed);
+    if (runStart != 0)
+    {
+        // Link the run in order, so every FAT sector is loaded and written once
+        for (cluster = runStart; (cluster < runStart + needed - 1) && (error == FILEIO_ERROR_NONE); cluster++)
+        {
+            if (FILEIO_FATWrite (disk, cluster, cluster + 1, false) == clusterFailValue)
+            {
+                error = FILEIO_ERROR_WRITE;
+            }
+        }
+        if ((error == FILEIO_ERROR_NONE) && (FILEIO_FATWrite (disk, cluster, eofValue, false) == clusterFailValue))
+        {
+            error = FILEIO_ERROR_WRITE;
+        }
+        // Attach the run to the file last, an interrupted update only leaves lost clusters
+        if ((error == FILEIO_ERROR_NONE) && (FILEIO_FATWrite (disk, lastCluster, runStart, false) == clusterFailValue))
+        {
+            error = FILEIO_ERROR_WRITE;
+        }
+        disk->currentCluster = runStart + needed - 1;
+    }
+    else
+    {
+        // No contiguous run left, take the clusters one at a time
+        while ((needed-- != 0) && (error == FILEIO_ERROR_NONE))
+        {
+            error = FILEIO_ClusterAllocate (disk, &lastCluster, false);
+        }
+    }
+
+    if (!FILEIO_FlushBuffer (disk, FILEIO_BUFFER_FAT) && (error == FILEIO_ERROR_NONE))
+    {
+        error = FILEIO_ERROR_WRITE;
+    }
+
+    disk->error = error;
+    if (error != FILEIO_ERROR_NONE)
+    {
+        return FILEIO_RESULT_FAILURE;
+    }
+    return FILEIO_RESULT_SUCCESS;
+}
+
+int FILEIO_Trim (FILEIO_OBJECT * filePtr)
+{
+    FILEIO_DRIVE * disk = filePtr->disk;
+    FILEIO_ERROR_TYPE error;
+
+    if (!filePtr->flags.writeEnabled)
+    {
+        disk->error = FILEIO_ERROR_READ_ONLY;
+        return FILEIO_RESULT_FAILURE;
+    }
+
+#if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
+    if (FILEIO_GetSingleBuffer (disk) != FILEIO_RESULT_SUCCESS)
+    {
+        return FILEIO_RESULT_FAILURE;
+    }
+#endif
+
+    if ((*disk->driveConfig->funcWriteProtectGet)(disk->mediaParameters))
+    {
+        disk->error = FILEIO_ERROR_WRITE_PROTECTED;
+        return FILEIO_RESULT_FAILURE;
+    }
+
+    error = FILEIO_ClusterChainTrim (filePtr);
+    filePtr->flags.preallocated = false;
+
+    if (!FILEIO_FlushBuffer (disk, FILEIO_BUFFER_FAT) && (error == FILEIO_ERROR_NONE))
+    {
+        error = FILEIO_ERROR_WRITE;
+    }
+
+    disk->error = error;
+    if (error != FILEIO_ERROR_NONE)
+    {
+        return FILEIO_RESULT_FAILURE;
+    }
+    return FILEIO_RESULT_SUCCESS;
+}
+
+FILEIO_ERROR_TYPE FILEIO_ClusterChainTrim (FILEIO_OBJECT * filePtr)
+{
+    FILEIO_DRIVE * disk = filePtr->disk;
+    FILEIO_ERROR_TYPE error;
+    uint32_t clusterSize, keep, cluster, nextCluster;
+    uint32_t eofValue, clusterFailValue;
+
+    switch (disk->type)
+    {
+        case FILEIO_FILE_SYSTEM_TYPE_FAT32:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT32_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT32_FAIL;
+            break;
+        case FILEIO_FILE_SYSTEM_TYPE_FAT12:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT12_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
+            break;
+        case FILEIO_FILE_SYSTEM_TYPE_FAT16:
+        default:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT16_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
+            break;
+    }
+
+    // A file always keeps its first cluster
+    clusterSize = (uint32_t)disk->sectorSize * disk->sectorsPerCluster;
+    keep = (filePtr->size + clusterSize - 1) / clusterSize;
+    if (keep == 0)
+    {
+        keep = 1;
+    }
+
+    // Walk to the last cluster that holds data
+    cluster = filePtr->firstCluster;
+    while (1)
+    {
+        if ((nextCluster = FILEIO_FATRead (disk, cluster)) == clusterFailValue)
+        {
+            return FILEIO_ERROR_BAD_SECTOR_READ;
+        }
+        if (nextCluster >= eofValue)
+        {
+            // Nothing behind the data
+            return FILEIO_ERROR_NONE;
+        }
+        if (--keep == 0)
+        {
+            break;
+        }
+        cluster = nextCluster;
+    }
+
+    // Terminate the chain first, an interrupted trim only leaves lost clusters
+    if (FILEIO_FATWrite (disk, cluster, eofValue, false) == clusterFailValue)
+    {
+        return FILEIO_ERROR_WRITE;
+    }
+
+    error = FILEIO_EraseClusterChain (nextCluster, disk);
+    if (error == FILEIO_ERROR_DONE)
+    {
+        error = FILEIO_ERROR_NONE;
+    }
+
+    // Let new allocations start at the freed clusters
+    disk->currentCluster = nextCluster;
+
+    return error;
+}
+#endif
+
+int FILEIO_SectorRangeGet (FILEIO_OBJECT * filePtr, uint32_t * firstSector, uint32_t * sectorCount)
+{
+    FILEIO_DRIVE * disk = filePtr->disk;
+    uint32_t cluster, nextCluster, clusterCount, runStart, runCount, bestStart, bestCount;
+    uint32_t eofValue, clusterFailValue;
+
+#if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
+    if (FILEIO_GetSingleBuffer (disk) != FILEIO_RESULT_SUCCESS)
+    {
+        return FILEIO_RESULT_FAILURE;
+    }
+#endif
+
+    switch (disk->type)
+    {
+        case FILEIO_FILE_SYSTEM_TYPE_FAT32:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT32_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT32_FAIL;
+            break;
+        case FILEIO_FILE_SYSTEM_TYPE_FAT12:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT12_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
+            break;
+        case FILEIO_FILE_SYSTEM_TYPE_FAT16:
+        default:
+            eofValue = FILEIO_CLUSTER_VALUE_FAT16_EOF;
+            clusterFailValue = FILEIO_CLUSTER_VALUE_FAT16_FAIL;
+            break;
+    }
+
+    cluster = filePtr->firstCluster;
+    clusterCount = 1;
+    runStart = cluster;
+    runCount = 1;
+    bestStart = cluster;
+    bestCount = 1;
+    while ((nextCluster = FILEIO_FATRead (disk, cluster)) < eofValue)
+    {
+        if ((nextCluster < 2) || (nextCluster >= (disk->partitionClusterCount + 2)))
+        {
+            disk->error = FILEIO_ERROR_INVALID_CLUSTER;
+            return FILEIO_RESULT_FAILURE;
+        }
+        clusterCount++;
+        if (nextCluster == cluster + 1)
+        {
+            runCount++;
+        }
+        else
+        {
+            runStart = nextCluster;
+            runCount = 1;
+        }
+        if (runCount > bestCount)
+        {
+            bestStart = runStart;
+            bestCount = runCount;
+        }
+        cluster = nextCluster;
+    }
+    if (nextCluster == clusterFailValue)
+    {
+        disk->error = FILEIO_ERROR_BAD_SECTOR_READ;
+        return FILEIO_RESULT_FAILURE;
+    }
+
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+    // The run may not reach the end of the chain, the size covers all of it
+    clusterCount *= (uint32_t)disk->sectorsPerCluster * disk->sectorSize;
+    if (filePtr->flags.writeEnabled && (filePtr->size < clusterCount))
+    {
+        filePtr->size = clusterCount;
+    }
+#endif
+
+    *firstSector = FILEIO_ClusterToSector (disk, bestStart);
+    *sectorCount = bestCount * disk->sectorsPerCluster;
+    disk->error = FILEIO_ERROR_NONE;
+    return FILEIO_RESULT_SUCCESS;
+}
+
 #if !defined (FILEIO_CONFIG_WRITE_DISABLE)
 int FILEIO_Flush (FILEIO_OBJECT * filePtr)
 {
@@ -2796,6 +3509,7 @@ size_t FILEIO_Write (const void * buffer, size_t size, size_t count, FILEIO_OBJE
     uint32_t currentSector;
     size_t dataWritten = 0;
     uint16_t writeCount;
+    uint16_t sectorCount;
     size_t length = size * count;
 
     if (!filePtr->flags.writeEnabled)
@@ -2853,6 +3567,53 @@ size_t FILEIO_Write (const void * buffer, size_t size, size_t count, FILEIO_OBJE
         currentSector = FILEIO_ClusterToSector (disk, filePtr->currentCluster);
         currentSector += filePtr->currentSector;
 
+        // Whole sectors go straight from the caller's buffer to the media,
+        // the ones up to the end of the cluster in a single write
+        if ((filePtr->currentOffset == 0) && (length >= disk->sectorSize))
+        {
+            sectorCount = disk->sectorsPerCluster - filePtr->currentSector;
+            if (sectorCount > (length / disk->sectorSize))
+            {
+                sectorCount = length / disk->sectorSize;
+            }
+
+            // A cached copy of one of the sectors is out of date now
+            if ((disk->bufferStatusPtr->dataBufferCachedSector >= currentSector) &&
+                (disk->bufferStatusPtr->dataBufferCachedSector < (currentSector + sectorCount)))
+            {
+                disk->bufferStatusPtr->dataBufferCachedSector = 0xFFFFFFFF;
+                disk->bufferStatusPtr->flags.dataBufferNeedsWrite = false;
+            }
+
+            if ((sectorCount > 1) && (disk->driveConfig->funcSectorsWrite != NULL))
+            {
+                if ((*disk->driveConfig->funcSectorsWrite) (disk->mediaParameters, currentSector, data, sectorCount, false) != true)
+                {
+                    disk->error = FILEIO_ERROR_WRITE;
+                    return dataWritten;
+                }
+            }
+            else
+            {
+                for (writeCount = 0; writeCount < sectorCount; writeCount++)
+                {
+                    if ((*disk->driveConfig->funcSectorWrite) (disk->mediaParameters, currentSector + writeCount, data + (writeCount * disk->sectorSize), false) != true)
+                    {
+                        disk->error = FILEIO_ERROR_WRITE;
+                        return dataWritten;
+                    }
+                }
+            }
+
+            // Leave the file at the end of the last sector, like a copy through the buffer does
+            filePtr->currentSector += sectorCount - 1;
+            filePtr->currentOffset = disk->sectorSize;
+            data += (size_t)sectorCount * disk->sectorSize;
+            dataWritten += (size_t)sectorCount * disk->sectorSize;
+            length -= (size_t)sectorCount * disk->sectorSize;
+            continue;
+        }
+
         // Cache the required sector, if necessary
         if (disk->bufferStatusPtr->dataBufferCachedSector != currentSector)
         {
@@ -2862,7 +3623,9 @@ size_t FILEIO_Write (const void * buffer, size_t size, size_t count, FILEIO_OBJE
                 return FILEIO_ERROR_WRITE;
             }
 
-            if(filePtr->size != filePtr->absoluteOffset)
+            // The sector only has to be read when it holds data that isn't
+            // overwritten: inside the file or in front of the end of the file
+            if((filePtr->size != filePtr->absoluteOffset) || (filePtr->currentOffset != 0))
             {
                 if ((*disk->driveConfig->funcSectorRead) (disk->mediaParameters, currentSector, disk->dataBuffer) != true)
                 {
@@ -3857,7 +4620,7 @@ int FILEIO_Format (FILEIO_DRIVE_CONFIG * config, void * mediaParameters, FILEIO_
 #if defined (FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE)
     bufferStatusPtr = &bufferStatus;
     d.dataBuffer = gDataBuffer;
-    d.fatBuffer = gFATBuffer;
+    d.fatBuffer = &gFATBuffer[0][0];
 
     if (bufferStatusPtr->driveOwner != NULL)
     {
@@ -3871,19 +4634,15 @@ int FILEIO_Format (FILEIO_DRIVE_CONFIG * config, void * mediaParameters, FILEIO_
             }
             bufferStatusPtr->flags.dataBufferNeedsWrite = false;
         }
-        if (bufferStatusPtr->flags.fatBufferNeedsWrite)
+        if (!FILEIO_FlushBuffer ((FILEIO_DRIVE *)bufferStatusPtr->driveOwner, FILEIO_BUFFER_FAT))
         {
-            if (! (*bufferDriveConfig->funcSectorWrite)(mediaParameters, bufferStatusPtr->fatBufferCachedSector, disk->fatBuffer, false))
-            {
-                return false;
-            }
-            bufferStatusPtr->flags.fatBufferNeedsWrite = false;
+            return false;
         }
     }
 #else
     bufferStatusPtr = &bufferStatus[FILEIO_CONFIG_MAX_DRIVES - 1];
     d.dataBuffer = gDataBuffer[FILEIO_CONFIG_MAX_DRIVES - 1];
-    d.fatBuffer = gFatBuffer[FILEIO_CONFIG_MAX_DRIVES - 1];
+    d.fatBuffer = &gFATBuffer[FILEIO_CONFIG_MAX_DRIVES - 1][0][0];
 
     if (!gDriveSlotOpen[FILEIO_CONFIG_MAX_DRIVES - 1])
     {
@@ -3895,20 +4654,16 @@ int FILEIO_Format (FILEIO_DRIVE_CONFIG * config, void * mediaParameters, FILEIO_
             }
             bufferStatusPtr->flags.dataBufferNeedsWrite = false;
         }
-        if (bufferStatusPtr->flags.fatBufferNeedsWrite)
+        if (!FILEIO_FlushBuffer (&gDriveArray[FILEIO_CONFIG_MAX_DRIVES - 1], FILEIO_BUFFER_FAT))
         {
-            if (! (*config->funcSectorWrite)(mediaParameters, bufferStatusPtr->fatBufferCachedSector, disk->fatBuffer, false))
-            {
-                return false;
-            }
-            bufferStatusPtr->flags.fatBufferNeedsWrite = false;
+            return false;
         }
     }
 
 #endif
 
     bufferStatusPtr->dataBufferCachedSector = 0xFFFFFFFF;
-    bufferStatusPtr->fatBufferCachedSector = 0xFFFFFFFF;
+    FILEIO_FATCacheInvalidate (bufferStatusPtr);
 
     disk->bufferStatusPtr = bufferStatusPtr;
     disk->driveConfig = config;
@@ -4690,7 +5445,7 @@ int FILEIO_GetSingleBuffer (FILEIO_DRIVE * drive)
 
         drive->bufferStatusPtr->driveOwner = drive;
         drive->bufferStatusPtr->dataBufferCachedSector = 0xFFFFFFFF;
-        drive->bufferStatusPtr->fatBufferCachedSector = 0xFFFFFFFF;
+        FILEIO_FATCacheInvalidate (drive->bufferStatusPtr);
     }
 
     return FILEIO_RESULT_SUCCESS;
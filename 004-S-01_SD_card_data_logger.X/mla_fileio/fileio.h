@@ -164,6 +164,7 @@ typedef struct
     {
         unsigned    writeEnabled :1;    // Indicates a file was opened in a mode that allows writes
         unsigned    readEnabled :1;     // Indicates a file was opened in a mode that allows reads
+        unsigned    preallocated :1;    // Indicates clusters past the end of the file must be freed on close
 
     } flags;
 } FILEIO_OBJECT;
@@ -334,6 +335,43 @@ typedef bool (*FILEIO_DRIVER_SectorRead)(void * mediaConfig, uint32_t sector_add
 ***************************************************************************/
 typedef uint8_t (*FILEIO_DRIVER_SectorWrite)(void * mediaConfig, uint32_t sector_addr, uint8_t* buffer, bool allowWriteToZero);
 
+/***************************************************************************
+    Function:
+        bool (*FILEIO_DRIVER_SectorsWrite)(void * mediaConfig,
+            uint32_t sectorAddress, uint8_t * buffer, uint16_t sectorCount,
+            bool allowWriteToZero);
+
+    Summary:
+        Function pointer prototype for a driver function to write several
+        consecutive sectors of data to the device.
+
+    Description:
+        Function pointer prototype for a driver function to write several
+        consecutive sectors of data to the device in one operation, e.g.
+        with a multi-block write command.  FILEIO_Write uses it for runs of
+        whole sectors within a cluster.  This function is optional; if it
+        is NULL the sectors are written one at a time with the SectorWrite
+        function.
+
+    Precondition:
+        The device will be initialized.
+
+    Parameters:
+        mediaConfig - Pointer to a driver-defined config structure
+        sectorAddress - The address of the first sector to write. This
+            address format depends on the media.
+        buffer - A buffer containing the data to write, sectorCount
+            sectors long.
+        sectorCount - The number of sectors to write.
+        allowWriteToZero - Check to prevent writing to the master boot
+            record.  See FILEIO_DRIVER_SectorWrite.
+
+    Returns:
+        If Success: true
+        If Failure: false
+***************************************************************************/
+typedef uint8_t (*FILEIO_DRIVER_SectorsWrite)(void * mediaConfig, uint32_t sector_addr, uint8_t* buffer, uint16_t sectorCount, bool allowWriteToZero);
+
 /***************************************************************************
     Function:
         bool (*FILEIO_DRIVER_WriteProtectStateGet)(void * mediaConfig);
@@ -369,6 +407,7 @@ typedef struct
     FILEIO_DRIVER_SectorRead funcSectorRead;                        // Function to read a sector of the media.
     FILEIO_DRIVER_SectorWrite funcSectorWrite;                      // Function to write a sector of the media.
     FILEIO_DRIVER_WriteProtectStateGet funcWriteProtectGet;         // Function to determine if the media is write-protected.
+    FILEIO_DRIVER_SectorsWrite funcSectorsWrite;                    // Function to write consecutive sectors of the media, or NULL.
 } FILEIO_DRIVE_CONFIG;
 
 // Structure that contains the disk search information, intermediate values, and results
@@ -992,6 +1031,117 @@ int FILEIO_Close (FILEIO_OBJECT * handle);
 ***************************************************************************/
 int FILEIO_Flush (FILEIO_OBJECT * handle);
 
+/***************************************************************************
+  Function:
+    int FILEIO_Preallocate (FILEIO_OBJECT * handle, uint32_t size)
+
+    Summary:
+        Reserves clusters for a file up front.
+
+    Description:
+        Extends the cluster chain of the file so it can hold 'size' bytes
+        without further FAT updates during FILEIO_Write.  The clusters are
+        taken as one contiguous run directly behind the end of the file when
+        possible, otherwise from the first free run on the drive, and the FAT
+        is updated in a single pass.  If no contiguous run is free the
+        clusters are allocated one at a time.  The file size itself is not
+        changed.  Clusters that are still unused when the file is closed are
+        freed again by FILEIO_Close, or by FILEIO_Trim if it never was.
+
+    Precondition:
+        The drive containing the file must be mounted and the file handle 
+        must represent a valid file opened in a write mode.
+
+    Parameters:
+        handle - The handle of the file.
+        size - The number of bytes the file should be able to hold.
+
+    Returns:
+      * If Success: FILEIO_RESULT_SUCCESS
+      * If Failure: FILEIO_RESULT_FAILURE
+
+      * Sets error code which can be retrieved with FILEIO_ErrorGet
+        * FILEIO_ERROR_READ_ONLY - The file was not opened in write mode.
+        * FILEIO_ERROR_WRITE_PROTECTED - The media is write-protected.
+        * FILEIO_ERROR_BAD_SECTOR_READ - The FAT could not be read.
+        * FILEIO_ERROR_INVALID_CLUSTER - The cluster chain of the file
+          is invalid.
+        * FILEIO_ERROR_WRITE - The FAT could not be written.
+        * FILEIO_ERROR_DRIVE_FULL - There are not enough free clusters.
+          The clusters that could be allocated stay reserved.
+***************************************************************************/
+int FILEIO_Preallocate (FILEIO_OBJECT * handle, uint32_t size);
+
+/***************************************************************************
+  Function:
+    int FILEIO_Trim (FILEIO_OBJECT * handle)
+
+    Summary:
+        Frees the clusters of a file behind its size.
+
+    Description:
+        Cuts the cluster chain of the file after the last cluster that holds
+        data and frees the rest, as FILEIO_Close does for a file that was
+        preallocated.  Use it on a file that was preallocated but never
+        closed, for example because the power failed while it was written.
+        The file keeps its first cluster.
+
+    Precondition:
+        The drive containing the file must be mounted and the file handle 
+        must represent a valid file opened in a write mode.
+
+    Parameters:
+        handle - The handle of the file.
+
+    Returns:
+      * If Success: FILEIO_RESULT_SUCCESS
+      * If Failure: FILEIO_RESULT_FAILURE
+
+      * Sets error code which can be retrieved with FILEIO_ErrorGet
+        * FILEIO_ERROR_READ_ONLY - The file was not opened in write mode.
+        * FILEIO_ERROR_WRITE_PROTECTED - The media is write-protected.
+        * FILEIO_ERROR_BAD_SECTOR_READ - The FAT could not be read.
+        * FILEIO_ERROR_WRITE - The FAT could not be written.
+***************************************************************************/
+int FILEIO_Trim (FILEIO_OBJECT * handle);
+
+/***************************************************************************
+  Function:
+    int FILEIO_SectorRangeGet (FILEIO_OBJECT * handle, uint32_t * firstSector,
+        uint32_t * sectorCount)
+
+    Summary:
+        Finds the longest run of consecutive sectors of a file.
+
+    Description:
+        Walks the cluster chain of the file and returns the longest run of
+        clusters that follow each other on the media, as a range of sectors.
+        The sectors can then be accessed through the driver directly without
+        going through the FAT.  If the file is opened in a write mode its
+        size is extended to cover its whole cluster chain, so clusters
+        reserved by FILEIO_Preallocate stay with the file when it is closed.
+        The contents of those clusters are not changed.
+
+    Precondition:
+        The drive containing the file must be mounted and the file handle 
+        must represent a valid opened file.
+
+    Parameters:
+        handle - The handle of the file.
+        firstSector - Set to the first sector of the run.
+        sectorCount - Set to the number of sectors in the run.
+
+    Returns:
+      * If Success: FILEIO_RESULT_SUCCESS
+      * If Failure: FILEIO_RESULT_FAILURE
+
+      * Sets error code which can be retrieved with FILEIO_ErrorGet
+        * FILEIO_ERROR_BAD_SECTOR_READ - The FAT could not be read.
+        * FILEIO_ERROR_INVALID_CLUSTER - The cluster chain of the file
+          is invalid.
+***************************************************************************/
+int FILEIO_SectorRangeGet (FILEIO_OBJECT * handle, uint32_t * firstSector, uint32_t * sectorCount);
+
 /***************************************************************************
   Function:
     int FILEIO_GetChar (FILEIO_OBJECT * handle)
@@ -1347,6 +1497,26 @@ int FILEIO_LongFileNameGet (FILEIO_SEARCH_RECORD * record, uint16_t * buffer, ui
   ********************************************************************/
 FILEIO_FILE_SYSTEM_TYPE FILEIO_FileSystemTypeGet (char driveId);
 
+/********************************************************************
+  Function:
+      uint32_t FILEIO_ClusterSizeGet (char driveId)
+    
+  Summary:
+    Returns the cluster size of a file system.
+  Description:
+    Returns the number of bytes in one cluster of a mounted drive.
+    Files grow by whole clusters, so this can be used to size files
+    without wasting space in their last cluster.
+  Conditions:
+    A drive must have been mounted by the FILEIO library.
+  Input:
+    driveId -  Character representation of the mounted device.
+  Return:
+      * If Success: The cluster size in bytes
+      * If Failure: 0
+  ********************************************************************/
+uint32_t FILEIO_ClusterSizeGet (char driveId);
+
 /*********************************************************************************
   Function:
     void FILEIO_DrivePropertiesGet()
@@ -62,7 +62,7 @@ SUBSTITUTE GOODS, TECHNOLOGY, SERVICES, OR ANY CLAIMS BY THIRD PARTIES
   Define FILEIO_CONFIG_FUNCTION_SEARCH to disable the functions used to
   search for files.                                                    
   **********************************************************************/
-#define FILEIO_CONFIG_SEARCH_DISABLE
+//#define FILEIO_CONFIG_SEARCH_DISABLE
 
 // Define FILEIO_CONFIG_FUNCTION_WRITE to disable the functions that write to a drive.  Disabling this feature will
 // force the file system into read-only mode.
@@ -84,4 +84,19 @@ SUBSTITUTE GOODS, TECHNOLOGY, SERVICES, OR ANY CLAIMS BY THIRD PARTIES
 // (defined by FILEIO_CONFIG_MAX_DRIVES).  If you are only using one drive in your application, this option has no effect.
 #define FILEIO_CONFIG_MULTIPLE_BUFFER_MODE_DISABLE
 
+// Number of FAT sectors cached per FAT buffer, from 1 to 8.  With more than one sector, cluster allocation that
+// crosses a FAT sector boundary, or that follows two cluster chains at once, doesn't write back and re-read the
+// same FAT sectors over and over.  The least recently used sector is replaced.  A modified sector and its mirror
+// copies in the other FATs are written to the media when the sector is replaced or the FAT is flushed.  Each
+// sector costs FILEIO_CONFIG_MEDIA_SECTOR_SIZE bytes of RAM.  The log files are preallocated in contiguous runs, so
+// a single sector is enough here.
+#define FILEIO_CONFIG_FAT_CACHE_SECTORS 1
+
+// Size in bytes of a RAM map of the FAT, kept per drive for FAT16 and FAT32.  Each bit covers a group of FAT sectors
+// and is cleared once a search for free clusters has read the whole group without finding one.  Later searches skip
+// those groups, so allocation on a nearly full card doesn't read the whole FAT.  A group is at least one FAT sector;
+// 32 bytes cover a 16 GB card with 4 kB clusters in groups of 32 sectors.  Comment out to disable the map.  The
+// next free cluster hint and free cluster count of the FAT32 FSInfo sector are used either way.
+#define FILEIO_CONFIG_FREE_MAP_SIZE     32
+
 #endif
@@ -78,14 +78,22 @@ typedef enum
 #define FILEIO_FAT_GOOD_SIGN_0          0x55        // FAT signature byte 0
 #define FILEIO_FAT_GOOD_SIGN_1          0xAA        // FAT signatury byte 1
 
+#if !defined (FILEIO_CONFIG_FAT_CACHE_SECTORS)
+    #define FILEIO_CONFIG_FAT_CACHE_SECTORS 1
+#endif
+#if (FILEIO_CONFIG_FAT_CACHE_SECTORS < 1) || (FILEIO_CONFIG_FAT_CACHE_SECTORS > 8)
+    #error FILEIO_CONFIG_FAT_CACHE_SECTORS must be 1 to 8
+#endif
+
 typedef struct
 {
     uint32_t dataBufferCachedSector;
-    uint32_t fatBufferCachedSector;
+    uint32_t fatBufferCachedSector[FILEIO_CONFIG_FAT_CACHE_SECTORS];    // Sector held by each entry of the FAT cache
+    uint8_t fatBufferOrder[FILEIO_CONFIG_FAT_CACHE_SECTORS];            // FAT cache entries from least to most recently used
     struct
     {
         unsigned dataBufferNeedsWrite : 1;
-        unsigned fatBufferNeedsWrite : 1;
+        unsigned fatBufferNeedsWrite : FILEIO_CONFIG_FAT_CACHE_SECTORS;    // One bit per FAT cache entry
     } flags;
     void * driveOwner;
 } FILEIO_BUFFER_STATUS;
@@ -102,7 +110,7 @@ typedef struct
     uint32_t    sectorSize;                 // The size of a sector in bytes
     uint32_t    fatSectorCount;             // The number of sectors in the FAT
     uint8_t *   dataBuffer;                 // Address of the global data buffer used to read and write file information
-    uint8_t *   fatBuffer;                  // Address of the fat buffer used to read and write sectors of the FAT
+    uint8_t *   fatBuffer;                  // Address of the fat buffer used to read and write sectors of the FAT, FILEIO_CONFIG_FAT_CACHE_SECTORS sectors
     FILEIO_BUFFER_STATUS * bufferStatusPtr;     // Pointer to a buffer status structure
     const FILEIO_DRIVE_CONFIG * driveConfig;    // Configuration information for the drive
     void *      mediaParameters;            // Parameters that describe which instance of the media to use (see [media].h for more information).
@@ -114,6 +122,17 @@ typedef struct
     uint8_t     error;                      // Last error that occurred for this drive
     char        driveId;
     uint32_t    currentCluster;             // Current cluster on the drive for file creation purposes.
+#if !defined (FILEIO_CONFIG_WRITE_DISABLE)
+    uint32_t    fsInfoSector;               // Logical block address of the FAT32 FSInfo sector, 0 if there is none
+    uint32_t    freeClusterCount;           // Number of free clusters, FILEIO_FSINFO_UNKNOWN if not known
+    uint8_t     fsInfoNeedsWrite;           // The free cluster count or the next free cluster changed since the FSInfo sector was written
+#if defined (FILEIO_CONFIG_FREE_MAP_SIZE)
+    uint8_t     freeMapShift;               // Clusters per bit of freeMap as a power of two, 0 if the map isn't used
+    uint32_t    freeMapScanStart;           // First cluster of the run of used clusters read by the last searches
+    uint32_t    freeMapScanEnd;             // Cluster behind that run
+    uint8_t     freeMap[FILEIO_CONFIG_FREE_MAP_SIZE];   // One bit per group of FAT sectors, cleared if the group has no free cluster
+#endif
+#endif
 } PACKED FILEIO_DRIVE;
 
 typedef struct
@@ -257,11 +276,29 @@ typedef struct {
 #define  BSI_FATSZ32       36
 // A macro for the boot sector start cluster of root directory value offset
 #define  BSI_ROOTCLUS      44
+// A macro for the boot sector FSInfo sector number offset
+#define  BSI_FSINFO        48
 //  A macro for the FAT32 boot sector boot signature offset
 #define  BSI_FAT32_BOOTSIG 66
 // A macro for the FAT32 boot sector file system type string offset
 #define  BSI_FAT32_FSTYPE  82
 
+// A macro for the FSInfo sector lead signature offset
+#define FSI_LEADSIG         0
+// A macro for the FSInfo sector structure signature offset
+#define FSI_STRUCSIG        484
+// A macro for the FSInfo sector free cluster count offset
+#define FSI_FREE_COUNT      488
+// A macro for the FSInfo sector next free cluster offset
+#define FSI_NXT_FREE        492
+// A macro for the FSInfo sector trail signature offset
+#define FSI_TRAILSIG        508
+
+#define FILEIO_FSINFO_LEADSIG       0x41615252ul    // FSInfo lead signature
+#define FILEIO_FSINFO_STRUCSIG      0x61417272ul    // FSInfo structure signature
+#define FILEIO_FSINFO_TRAILSIG      0xAA550000ul    // FSInfo trail signature
+#define FILEIO_FSINFO_UNKNOWN       0xFFFFFFFFul    // Free cluster count or next free cluster not known
+
 
 // Structure of a partition table entry
 typedef struct
@@ -320,6 +357,8 @@ uint8_t FILEIO_FileNameTypeGet (const char * fileName, bool partialStringSearch)
 bool FILEIO_ShortFileNameCompare (uint8_t * fileName1, uint8_t * fileName2, uint8_t mode);
 uint32_t FILEIO_FATWrite (FILEIO_DRIVE *disk, uint32_t currentCluster, uint32_t value, uint8_t forceWrite);
 uint32_t FILEIO_FATRead (FILEIO_DRIVE * disk, uint32_t currentCluster);
+uint8_t * FILEIO_FATSectorGet (FILEIO_DRIVE * disk, uint32_t sector);
+void FILEIO_FATCacheInvalidate (FILEIO_BUFFER_STATUS * status);
 FILEIO_DIRECTORY_ENTRY * FILEIO_DirectoryEntryCache (FILEIO_DIRECTORY * directory, FILEIO_ERROR_TYPE * error, uint32_t * currentCluster, uint16_t * currentClusterOffset, uint16_t entryOffset);
 bool FILEIO_FlushBuffer (FILEIO_DRIVE * disk, FILEIO_BUFFER_ID bufferId);
 FILEIO_ERROR_TYPE FILEIO_EraseClusterChain (uint32_t cluster, FILEIO_DRIVE * disk);
@@ -327,6 +366,10 @@ FILEIO_ERROR_TYPE FILEIO_DirectoryEntryCreate (FILEIO_OBJECT * filePtr, uint8_t
 FILEIO_ERROR_TYPE FILEIO_ClusterAllocate (FILEIO_DRIVE * drive, uint32_t * cluster, bool eraseCluster);
 FILEIO_ERROR_TYPE FILEIO_EraseCluster (FILEIO_DRIVE * drive, uint32_t cluster);
 uint32_t FILEIO_FindEmptyCluster (FILEIO_DRIVE * drive);
+uint32_t FILEIO_FindEmptyClusterRun (FILEIO_DRIVE * drive, uint32_t start, uint32_t count);
+FILEIO_ERROR_TYPE FILEIO_ClusterChainTrim (FILEIO_OBJECT * filePtr);
+void FILEIO_FSInfoLoad (FILEIO_DRIVE * drive);
+int FILEIO_FSInfoWrite (FILEIO_DRIVE * drive);
 uint32_t FILEIO_CreateFirstCluster (FILEIO_OBJECT * filePtr);
 FILEIO_ERROR_TYPE FILEIO_FindShortFileName (FILEIO_DIRECTORY * directory, FILEIO_OBJECT * filePtr, uint8_t * fileName, uint32_t * currentCluster, uint16_t * currentClusterOffset, uint16_t entryOffset, uint16_t attributes, FILEIO_SEARCH_TYPE mode);
 FILEIO_ERROR_TYPE FILEIO_EraseFile (FILEIO_OBJECT * filePtr, uint16_t * entryHandle, bool eraseData);
@@ -46,6 +46,24 @@ uint8_t gSDMode;
 static FILEIO_MEDIA_INFORMATION mediaInformation;
 static FILEIO_SD_ASYNC_IO ioInfo; //Declared global context, for fast/code efficient access
 static uint8_t gSDMediaState = FILEIO_SD_STATE_NOT_INITIALIZED;
+#if defined (FILEIO_SD_CONFIG_WRITE_STREAM)
+static bool writeStreamOpen = false;        //A multi-block write is left open between sector writes
+static uint32_t writeStreamNextSector;      //Sector the next block of the open stream is written to
+static uint32_t writeStreamLastEnd = 0;     //Sector behind the last write, a write there continues it
+static void FILEIO_SD_WriteStreamAbort(FILEIO_SD_DRIVE_CONFIG * config);
+#endif
+#if defined (__XC16__) && defined (DRV_SPI_CONFIG_V2_ENABLED)
+//The SPI clock is negotiated from the CSD of the media
+#define FILEIO_SD_SPI_CLOCK_NEGOTIATE
+static uint16_t spiClockBrg;                //SPI baud rate generator value of the fast clock
+static uint16_t spiClockBrgSlow;            //Baud rate generator value of the initialization clock
+#if defined (FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS)
+static uint8_t spiClockErrors = 0;          //Consecutive failed sector reads or writes
+#endif
+static uint32_t FILEIO_SD_TranSpeedDecode(uint8_t tranSpeed);
+static void FILEIO_SD_SPIClockSet(FILEIO_SD_DRIVE_CONFIG * config);
+#endif
+static void FILEIO_SD_SPIClockCheck(FILEIO_SD_DRIVE_CONFIG * config, bool success);
 
 // Summary: Table of SD card commands and parameters
 // Description: The sdmmc_cmdtable contains an array of SD card commands, the corresponding CRC code, the
@@ -277,6 +295,11 @@ bool FILEIO_SD_MediaDeinitialize(FILEIO_SD_DRIVE_CONFIG * config)
 {
     FILEIO_SD_CSSet tmp = config->csFunc;
 
+#if defined (FILEIO_SD_CONFIG_WRITE_STREAM)
+    FILEIO_SD_WriteStreamStop(config);
+    writeStreamLastEnd = 0;
+#endif
+
     // close the spi bus
     DRV_SPI_Deinitialize (config->index);
 
@@ -541,6 +564,14 @@ bool FILEIO_SD_SectorRead(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddres
     FILEIO_SD_ASYNC_IO info;
     uint8_t status;
     
+#if defined (FILEIO_SD_CONFIG_WRITE_STREAM)
+    //The media can't read while a multi-block write is open
+    if(FILEIO_SD_WriteStreamStop(config) == false)
+    {
+        return false;
+    }
+#endif
+
     //Initialize info structure for using the FILEIO_SD_AsyncReadTasks() function.
     info.wNumBytes = 512;
     info.dwBytesRemaining = 512;
@@ -558,10 +589,12 @@ bool FILEIO_SD_SectorRead(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddres
         status = FILEIO_SD_AsyncReadTasks(config, &info);
         if(status == FILEIO_SD_ASYNC_READ_COMPLETE)
         {
+            FILEIO_SD_SPIClockCheck(config, true);
             return true;
         }
         else if(status == FILEIO_SD_ASYNC_READ_ERROR)
         {
+            FILEIO_SD_SPIClockCheck(config, false);
             return false;
         } 
     }       
@@ -873,6 +906,25 @@ uint8_t FILEIO_SD_AsyncReadTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASYN
     #endif
 }    
 
+#if defined (FILEIO_SD_CONFIG_WRITE_BUSY_TIMING)
+// Busy time of the current write operation and start of the busy period
+static uint32_t writeBusyTime;
+static uint32_t writeBusyStart;
+
+uint32_t FILEIO_SD_WriteBusyTimeGet(void)
+{
+    return writeBusyTime;
+}
+
+    #define FILEIO_SD_WriteBusyTimingReset()    writeBusyTime = 0
+    #define FILEIO_SD_WriteBusyTimingStart()    writeBusyStart = FILEIO_SD_TimeGet()
+    #define FILEIO_SD_WriteBusyTimingStop()     writeBusyTime += FILEIO_SD_TimeGet() - writeBusyStart
+#else
+    #define FILEIO_SD_WriteBusyTimingReset()
+    #define FILEIO_SD_WriteBusyTimingStart()
+    #define FILEIO_SD_WriteBusyTimingStop()
+#endif
+
 /*****************************************************************************
   Function:
     uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_ASYNC_IO* info)
@@ -1004,6 +1056,7 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
             //Initiate the write sequence.
             gSDMediaState = FILEIO_SD_STATE_BUSY;         //Let other code in the app know that the media is busy (so it doesn't also try to send the SD card commands of it's own)
             blockCounter = FILEIO_SD_MEDIA_BLOCK_SIZE;    //Initialize counter.  Will be used later for block boundary tracking.
+            FILEIO_SD_WriteBusyTimingReset();
 
             //Copy input structure into a statically allocated global instance 
             //of the structure, for faster local access of the parameters with 
@@ -1123,6 +1176,7 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
                 //writen and the card is ready to accept a new block.
                 info->bStateVariable = FILEIO_SD_ASYNC_WRITE_MEDIA_BUSY;
                 WriteTimeout = FILEIO_SD_WRITE_TIMEOUT;       //Initialize timeout counter
+                FILEIO_SD_WriteBusyTimingStart();
                 return FILEIO_SD_ASYNC_WRITE_BUSY;
             }//if(blockCounter == 0)
             
@@ -1138,6 +1192,7 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
                 data_byte = DRV_SPI_Get(config->index);  //Poll the media.  Will return 0x00 if still busy.  Will return non-0x00 is ready for next data block.
                 if(data_byte != 0x00)
                 {
+                    FILEIO_SD_WriteBusyTimingStop();
                     //The media is done and is no longer busy.  Go ahead and
                     //either send the next packet of data to the media, or the stop
                     //token if we are finished.
@@ -1156,6 +1211,7 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
                             FILEIO_SD_Send8ClockCycles(config->index);
                                                 
                             //The media still needs to finish internally writing.
+                            FILEIO_SD_WriteBusyTimingStart();
                             info->bStateVariable = FILEIO_SD_ASYNC_STOP_TOKEN_SENT_WAIT_BUSY;
                             return FILEIO_SD_ASYNC_WRITE_BUSY;
                         }
@@ -1186,6 +1242,7 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
             {
                 //Timeout occurred.  Something went wrong.  The media should not 
                 //have taken this long to finish the write.
+                FILEIO_SD_WriteBusyTimingStop();
                 info->bStateVariable = FILEIO_SD_ASYNC_WRITE_ABORT;
                 return FILEIO_SD_ASYNC_WRITE_BUSY;
             }        
@@ -1202,6 +1259,7 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
                 //Check if card is no longer busy.  
                 if(data_byte != 0x00)
                 {
+                    FILEIO_SD_WriteBusyTimingStop();
                     //If we get to here, multi-block write operation is fully
                     //complete now.  
 
@@ -1218,6 +1276,7 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
                 //If we get to here, the media is still busy with the write.
                 return FILEIO_SD_ASYNC_WRITE_BUSY;    
             }    
+            FILEIO_SD_WriteBusyTimingStop();
             //Timeout occurred.  Something went wrong.  Fall through to FILEIO_SD_ASYNC_WRITE_ABORT.
         case FILEIO_SD_ASYNC_WRITE_ABORT:
             //An error occurred, and we need to stop the write sequence so as to try and allow
@@ -1242,6 +1301,12 @@ uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASY
 
 
 bool FILEIO_SD_SectorWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddress, uint8_t* buffer, bool allowWriteToZero)
+{
+    return FILEIO_SD_SectorsWrite(config, sectorAddress, buffer, 1, allowWriteToZero);
+}    
+
+
+bool FILEIO_SD_SectorsWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddress, uint8_t* buffer, uint16_t sectorCount, bool allowWriteToZero)
 {
     static FILEIO_SD_ASYNC_IO info;
     uint8_t status;
@@ -1253,10 +1318,47 @@ bool FILEIO_SD_SectorWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddre
             return false;
         }    
     }    
+
+#if defined (FILEIO_SD_CONFIG_WRITE_STREAM)
+    //A write that doesn't continue the open stream ends it.  A write that
+    //continues the previous one opens a stream, so a run of sequential writes
+    //only pays for a single command.
+    if(writeStreamOpen && (sectorAddress != writeStreamNextSector))
+    {
+        if(FILEIO_SD_WriteStreamStop(config) == false)
+        {
+            return false;
+        }
+    }
+    if(!writeStreamOpen && (sectorAddress == writeStreamLastEnd) && (sectorAddress != 0))
+    {
+        if(FILEIO_SD_WriteStreamStart(config, sectorAddress, 0) == false)
+        {
+            return false;
+        }
+    }
+    if(writeStreamOpen)
+    {
+        FILEIO_SD_WriteBusyTimingReset();
+        while(sectorCount-- != 0)
+        {
+            if(FILEIO_SD_WriteStreamPut(config, buffer) == false)
+            {
+                FILEIO_SD_SPIClockCheck(config, false);
+                return false;
+            }
+            buffer += 512;
+        }
+        writeStreamLastEnd = writeStreamNextSector;
+        FILEIO_SD_SPIClockCheck(config, true);
+        return true;
+    }
+#endif
     
-    //Initialize structure so we write a single sector worth of data.
+    //Initialize structure so we write sectorCount sectors worth of data, one
+    //sector per packet.  More than one sector uses a multi-block write.
     info.wNumBytes = 512;
-    info.dwBytesRemaining = 512;
+    info.dwBytesRemaining = (uint32_t)sectorCount * 512;
     info.pBuffer = buffer;
     info.dwAddress = sectorAddress;
     info.bStateVariable = FILEIO_SD_ASYNC_WRITE_QUEUED;
@@ -1266,12 +1368,23 @@ bool FILEIO_SD_SectorWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddre
     while(1)
     {
         status = FILEIO_SD_AsyncWriteTasks(config, &info);
-        if(status == FILEIO_SD_ASYNC_WRITE_COMPLETE)
+        if(status == FILEIO_SD_ASYNC_WRITE_SEND_PACKET)
         {
+            //The handler wants the next sector
+            info.pBuffer = buffer;
+            buffer += 512;
+        }
+        else if(status == FILEIO_SD_ASYNC_WRITE_COMPLETE)
+        {
+#if defined (FILEIO_SD_CONFIG_WRITE_STREAM)
+            writeStreamLastEnd = sectorAddress + sectorCount;
+#endif
+            FILEIO_SD_SPIClockCheck(config, true);
             return true;
         }    
         else if(status == FILEIO_SD_ASYNC_WRITE_ERROR)
         {
+            FILEIO_SD_SPIClockCheck(config, false);
             return false;
         }
     }    
@@ -1279,6 +1392,150 @@ bool FILEIO_SD_SectorWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddre
 }    
 
 
+#if defined (FILEIO_SD_CONFIG_WRITE_STREAM)
+bool FILEIO_SD_WriteStreamStart(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddress, uint32_t preEraseCount)
+{
+    FILEIO_SD_RESPONSE response;
+    uint32_t address = sectorAddress;
+
+    if(writeStreamOpen)
+    {
+        if(FILEIO_SD_WriteStreamStop(config) == false)
+        {
+            return false;
+        }
+    }
+
+    //Never stream over the master boot record
+    if(sectorAddress == 0x00000000)
+    {
+        return false;
+    }
+
+    gSDMediaState = FILEIO_SD_STATE_BUSY;         //Keep other code from sending commands while the stream is open
+
+    //ACMD23 lets the media pre-erase the blocks.  Blocks that are pre-erased but
+    //not written before the stream is stopped have undefined contents.
+    if(preEraseCount != 0)
+    {
+        response = FILEIO_SD_SendCmd(config, FILEIO_SD_APP_CMD, 0x00000000);    //Send CMD55
+        if(response.r1._byte == 0x00)   //Check if successful.
+        {
+            FILEIO_SD_SendCmd(config, FILEIO_SD_SET_WRITE_BLOCK_ERASE_COUNT, preEraseCount);    //Send ACMD23
+        }
+    }
+
+    //Standard capacity cards expect a byte address, SDHC cards a block address
+    if (gSDMode == FILEIO_SD_MODE_NORMAL)  
+    {
+        address <<= 9;   //<< 9 multiplies by 512
+    }    
+
+    response = FILEIO_SD_SendCmd(config, FILEIO_SD_WRITE_MULTI_BLOCK, address);
+    if(response.r1._byte != 0x00)
+    {
+        (*config->csFunc)(1);       // De-select media
+        FILEIO_SD_Send8ClockCycles(config->index);
+        gSDMediaState = FILEIO_SD_STATE_READY_FOR_COMMAND;
+        return false;
+    }
+
+    writeStreamOpen = true;
+    writeStreamNextSector = sectorAddress;
+    return true;
+}
+
+
+bool FILEIO_SD_WriteStreamPut(FILEIO_SD_DRIVE_CONFIG * config, uint8_t* buffer)
+{
+    uint32_t timeout;
+    uint8_t data_byte;
+
+    if(!writeStreamOpen)
+    {
+        return false;
+    }
+
+    DRV_SPI_Put (config->index, FILEIO_SD_DATA_START_MULTI_BLOCK_TOKEN);
+    DRV_SPI_PutBuffer (config->index, buffer, 512);
+    FILEIO_SD_CRCSend(config->index);  //Send 16-bit CRC for the data block just sent
+
+    //Read response token uint8_t from media, mask out top three don't care bits
+    if((DRV_SPI_Get(config->index) &  FILEIO_SD_WRITE_RESPONSE_TOKEN_MASK) != FILEIO_SD_DATA_ACCEPTED)
+    {
+        FILEIO_SD_WriteStreamAbort(config);
+        return false;
+    }
+
+    //The media sends busy token (0x00) uint8_ts until it can accept the next block
+    FILEIO_SD_WriteBusyTimingStart();
+    FILEIO_SD_Send8ClockCycles(config->index);  //NBR timing parameter
+    timeout = FILEIO_SD_WRITE_TIMEOUT;
+    do
+    {
+        data_byte = DRV_SPI_Get(config->index);
+        timeout--;
+    }while((data_byte == 0x00) && (timeout != 0));
+    FILEIO_SD_WriteBusyTimingStop();
+
+    if(data_byte == 0x00)
+    {
+        FILEIO_SD_WriteStreamAbort(config);
+        return false;
+    }
+
+    writeStreamNextSector++;
+    return true;
+}
+
+
+bool FILEIO_SD_WriteStreamStop(FILEIO_SD_DRIVE_CONFIG * config)
+{
+    uint32_t timeout;
+    uint8_t data_byte;
+
+    if(!writeStreamOpen)
+    {
+        return true;
+    }
+    writeStreamOpen = false;
+
+    //Send the stop token, then gobble up one uint8_t before checking for
+    //media busy (0x00) to meet the NBR timing parameter.
+    DRV_SPI_Put (config->index, FILEIO_SD_DATA_STOP_TRAN_TOKEN);
+    FILEIO_SD_Send8ClockCycles(config->index);
+
+    //The media still needs to finish internally writing.
+    FILEIO_SD_WriteBusyTimingStart();
+    timeout = FILEIO_SD_WRITE_TIMEOUT;
+    do
+    {
+        data_byte = DRV_SPI_Get(config->index);
+        timeout--;
+    }while((data_byte == 0x00) && (timeout != 0));
+    FILEIO_SD_WriteBusyTimingStop();
+
+    (*config->csFunc)(1);       // De-select media
+    FILEIO_SD_Send8ClockCycles(config->index);  //NEC timing parameter clocking
+    gSDMediaState = FILEIO_SD_STATE_READY_FOR_COMMAND;
+
+    return (data_byte != 0x00);
+}
+
+
+static void FILEIO_SD_WriteStreamAbort(FILEIO_SD_DRIVE_CONFIG * config)
+{
+    //Stop the write sequence so as to try and allow for recovery/re-attempt later.
+    writeStreamOpen = false;
+    writeStreamLastEnd = 0;
+    FILEIO_SD_SendCmd(config, FILEIO_SD_STOP_TRANSMISSION, 0x00000000);
+    (*config->csFunc)(1);  // De-select media
+    FILEIO_SD_Send8ClockCycles(config->index);  //After raising CS pin, media may not tri-state data out for 1 bit time.
+    gSDMediaState = FILEIO_SD_STATE_READY_FOR_COMMAND;
+}
+#endif
+
+
 bool FILEIO_SD_WriteProtectStateGet(FILEIO_SD_DRIVE_CONFIG * config)
 {
     return (*config->wpFunc)();
@@ -1361,7 +1618,7 @@ void FILEIO_SD_SPISlowInitialize(FILEIO_SD_DRIVE_CONFIG * config)
     	#else //else C30 = PIC24/dsPIC devices
             #if defined(DRV_SPI_CONFIG_V2_ENABLED)
             spiInitData.cke = 0;
-            spiInitData.primaryPrescale = (SYS_CLK_FrequencyInstructionGet() / 400000 );
+            spiInitData.primaryPrescale = FILEIO_SD_SPI_BRG(400000);
             spiInitData.mode = SPI_TRANSFER_MODE_8BIT;
             #else
             uint16_t spiconvalue = 0x0003;
@@ -1437,6 +1694,84 @@ void FILEIO_SD_SPISlowInitialize(FILEIO_SD_DRIVE_CONFIG * config)
 }    
 
 
+#if defined (FILEIO_SD_SPI_CLOCK_NEGOTIATE)
+// Summary: Decodes the TRAN_SPEED field of the CSD to a clock in Hz
+// Description: Bits 6:3 are the time value 1.0 to 8.0, bits 2:0 the rate unit
+//              100 kbit/s to 100 Mbit/s.  Reserved values give the 25 MHz all
+//              SD media support.
+static uint32_t FILEIO_SD_TranSpeedDecode(uint8_t tranSpeed)
+{
+    //Time values times 10
+    static const uint8_t timeValue[16] = {0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80};
+    uint32_t clock = 10000;     //Rate unit 0, 100 kbit/s divided by the 10 of the time values
+    uint8_t unit = tranSpeed & 0x07;
+
+    if((unit > 3) || (timeValue[(tranSpeed >> 3) & 0x0F] == 0))
+    {
+        return 25000000ul;
+    }
+    while(unit-- != 0)
+    {
+        clock *= 10;
+    }
+    return clock * timeValue[(tranSpeed >> 3) & 0x0F];
+}
+
+// Summary: Initializes the SPI module with the current fast clock
+static void FILEIO_SD_SPIClockSet(FILEIO_SD_DRIVE_CONFIG * config)
+{
+    DRV_SPI_INIT_DATA spiInitData;
+
+    spiInitData.channel = config->index;
+    spiInitData.primaryPrescale = spiClockBrg;
+    spiInitData.secondaryPrescale = 0;
+    spiInitData.cke = 0;
+    spiInitData.spibus_mode = SPI_BUS_MODE_2;
+    spiInitData.mode = SPI_TRANSFER_MODE_8BIT;
+    DRV_SPI_Initialize(&spiInitData);
+}
+#endif
+
+// Summary: Counts failed sector reads and writes, and halves the SPI clock
+//          after FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS in a row.
+// Description: Only called with the media deselected, so the SPI module can
+//              be initialized again.
+static void FILEIO_SD_SPIClockCheck(FILEIO_SD_DRIVE_CONFIG * config, bool success)
+{
+#if defined (FILEIO_SD_SPI_CLOCK_NEGOTIATE) && defined (FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS)
+    if(success)
+    {
+        spiClockErrors = 0;
+        return;
+    }
+    if(++spiClockErrors < FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS)
+    {
+        return;
+    }
+    spiClockErrors = 0;
+    if(spiClockBrg < spiClockBrgSlow)
+    {
+        spiClockBrg = (spiClockBrg * 2) + 1;    //SCK = Fp / (2 * (BRG + 1)), half the clock
+        if(spiClockBrg > spiClockBrgSlow)
+        {
+            spiClockBrg = spiClockBrgSlow;
+        }
+        FILEIO_SD_SPIClockSet(config);
+    }
+#endif
+}
+
+
+uint32_t FILEIO_SD_SPIClockGet(void)
+{
+#if defined (FILEIO_SD_SPI_CLOCK_NEGOTIATE)
+    return SYS_CLK_FrequencyPeripheralGet() / (2 * ((uint32_t)spiClockBrg + 1));
+#else
+    return 0;
+#endif
+}
+
+
 FILEIO_MEDIA_INFORMATION *  FILEIO_SD_MediaInitialize (FILEIO_SD_DRIVE_CONFIG * config)
 {
     uint16_t timeout;
@@ -1447,6 +1782,9 @@ FILEIO_MEDIA_INFORMATION *  FILEIO_SD_MediaInitialize (FILEIO_SD_DRIVE_CONFIG *
 	uint8_t c_size_mult;
 	uint8_t block_len;
     DRV_SPI_INIT_DATA spiInitData;
+#if defined (FILEIO_SD_SPI_CLOCK_NEGOTIATE)
+    uint32_t clock;
+#endif
 
 	#ifdef __DEBUG_UART
 	InitUART();
@@ -1455,6 +1793,10 @@ FILEIO_MEDIA_INFORMATION *  FILEIO_SD_MediaInitialize (FILEIO_SD_DRIVE_CONFIG *
     //Initialize global variables.  Will get updated later with valid data once
     //the data is known.
     gSDMediaState = FILEIO_SD_STATE_NOT_INITIALIZED;
+#if defined (FILEIO_SD_CONFIG_WRITE_STREAM)
+    writeStreamOpen = false;
+    writeStreamLastEnd = 0;
+#endif
     mediaInformation.errorCode = MEDIA_NO_ERROR;
     mediaInformation.validityFlags.value = 0;
     finalLBA = 0x00000000;	//Will compute a valid size later, from the CSD register values we get from the card
@@ -1724,7 +2066,7 @@ FILEIO_MEDIA_INFORMATION *  FILEIO_SD_MediaInitialize (FILEIO_SD_DRIVE_CONFIG *
     	#else //else C30 = PIC24/dsPIC devices
             #if defined(DRV_SPI_CONFIG_V2_ENABLED)
                 spiInitData.cke = 0;
-                spiInitData.primaryPrescale = (SYS_CLK_FrequencyInstructionGet() / 9000000);
+                spiInitData.primaryPrescale = FILEIO_SD_SPI_BRG(9000000);
                 spiInitData.mode = SPI_TRANSFER_MODE_8BIT;
             #else
                 spiInitData.cke = 0;
@@ -1869,6 +2211,26 @@ FILEIO_MEDIA_INFORMATION *  FILEIO_SD_MediaInitialize (FILEIO_SD_DRIVE_CONFIG *
     //Deselect media while not actively accessing the card.
     (*config->csFunc)(1);
 
+#if defined (FILEIO_SD_SPI_CLOCK_NEGOTIATE)
+    //Switch to the fastest SPI clock at or below the maximum transfer rate of
+    //the media (TRAN_SPEED, CSD bits 103:96) and the limit of the board.
+    clock = FILEIO_SD_TranSpeedDecode(CSDResponse[3]);
+    if(clock > FILEIO_SD_CONFIG_SPI_CLOCK_MAX)
+    {
+        clock = FILEIO_SD_CONFIG_SPI_CLOCK_MAX;
+    }
+    spiClockBrg = FILEIO_SD_SPI_BRG(clock);
+    spiClockBrgSlow = FILEIO_SD_SPI_BRG(400000);
+    if(spiClockBrg > spiClockBrgSlow)
+    {
+        spiClockBrg = spiClockBrgSlow;
+    }
+#if defined (FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS)
+    spiClockErrors = 0;
+#endif
+    FILEIO_SD_SPIClockSet(config);
+#endif
+
     #ifdef __DEBUG_UART  
     PrintROMASCIIStringUART("Returning from MediaInitialize() function.\r\n");
     #endif
@@ -453,6 +453,40 @@ bool FILEIO_SD_SectorRead(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sector_addr,
   ***************************************************************************************/
 bool FILEIO_SD_SectorWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sector_addr, uint8_t * buffer, bool allowWriteToZero);
 
+/*****************************************************************************
+  Function:
+    bool FILEIO_SD_SectorsWrite (FILEIO_SD_DRIVE_CONFIG * config,
+        uint32_t sector_addr, uint8_t * buffer, uint16_t sectorCount,
+        bool allowWriteToZero)
+  Summary:
+    Writes consecutive sectors of data to an SD card.
+  Conditions:
+    The FILEIO_SD_SectorsWrite function pointer must be pointing to this function.
+  Input:
+    config - An SD Drive configuration structure pointer
+    sectorAddress -      The address of the first sector on the card.
+    buffer -           The buffer with the data to write, sectorCount sectors long.
+    sectorCount -      The number of sectors to write.
+    allowWriteToZero -
+                     - true -  Writes to the 0 sector (MBR) are allowed
+                     - false - Any write to the 0 sector will fail.
+  Return Values:
+    true -  The sectors were written successfully.
+    false - The sectors could not be written.
+  Side Effects:
+    None.
+  Description:
+    The FILEIO_SD_SectorsWrite function writes sectorCount sectors of data from
+    the location pointed to by 'buffer' to the SD card, starting at the
+    specified sector.  More than one sector is written with a single multi-block
+    write command (CMD25), preceded by ACMD23 so the card can pre-erase the
+    blocks, which saves the command and response of every further sector.
+  Remarks:
+    A single sector is written with a single block write, the same as
+    FILEIO_SD_SectorWrite.
+  ***************************************************************************************/
+bool FILEIO_SD_SectorsWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sector_addr, uint8_t * buffer, uint16_t sectorCount, bool allowWriteToZero);
+
 /*******************************************************************************
   Function:
     uint8_t FILEIO_SD_WriteProtectStateGet
@@ -476,6 +510,133 @@ bool FILEIO_SD_SectorWrite(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sector_addr
 *******************************************************************************/
 bool FILEIO_SD_WriteProtectStateGet(FILEIO_SD_DRIVE_CONFIG * config);
 
+/*******************************************************************************
+  Function:
+    uint32_t FILEIO_SD_WriteBusyTimeGet (void)
+  Summary:
+    Returns how long the card was busy during the last write.
+  Conditions:
+    FILEIO_SD_CONFIG_WRITE_BUSY_TIMING must be defined in sd_spi_config.h.
+  Input:
+    None
+  Return Values:
+    The time in microseconds the card signalled busy after the written blocks
+    of the last write operation, measured with FILEIO_SD_TimeGet().
+  Side Effects:
+    None.
+  Description:
+    After each data block the card keeps the data line low until the block is
+    programmed.  The write functions poll the card during that time, so this
+    is the part of the write time spent waiting on the card instead of
+    transferring data.
+  Remarks:
+    The application must provide uint32_t FILEIO_SD_TimeGet (void).
+*******************************************************************************/
+uint32_t FILEIO_SD_WriteBusyTimeGet(void);
+uint32_t FILEIO_SD_TimeGet(void);
+
+/*******************************************************************************
+  Function:
+    uint32_t FILEIO_SD_SPIClockGet (void)
+  Summary:
+    Returns the SPI clock used for the media.
+  Conditions:
+    The media must be initialized.
+  Input:
+    None.
+  Return Values:
+    The SPI clock in Hz, 0 if the driver doesn't negotiate the clock on this
+    processor.
+  Side Effects:
+    None.
+  Description:
+    After initialization the SPI clock is the fastest one at or below the
+    TRAN_SPEED of the media's CSD and FILEIO_SD_CONFIG_SPI_CLOCK_MAX.  It is
+    halved after FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS consecutive failed
+    sector reads or writes.
+  Remarks:
+    For diagnostics, e.g. to spot marginal wiring.
+*******************************************************************************/
+uint32_t FILEIO_SD_SPIClockGet(void);
+
+/*******************************************************************************
+  Function:
+    bool FILEIO_SD_WriteStreamStart (FILEIO_SD_DRIVE_CONFIG * config,
+        uint32_t sectorAddress, uint32_t preEraseCount)
+  Summary:
+    Opens a multi-block write at a sector of the card.
+  Conditions:
+    FILEIO_SD_CONFIG_WRITE_STREAM must be defined in sd_spi_config.h.
+  Input:
+    config - An SD Drive configuration structure pointer
+    sectorAddress - The sector the first block of the stream is written to.
+    preEraseCount - Number of blocks the card may pre-erase (ACMD23), 0 for none.
+  Return Values:
+    true -  The stream is open.
+    false - The card didn't accept the write command.
+  Side Effects:
+    A stream that is already open is stopped first.
+  Description:
+    Sends CMD25 and leaves the card selected.  The sectors are then sent one by
+    one with FILEIO_SD_WriteStreamPut(), or with FILEIO_SD_SectorWrite() and
+    FILEIO_SD_SectorsWrite(), which continue the stream as long as the writes
+    are sequential.  The sector writes open a stream by themselves when a
+    write continues the previous one, this function is only needed to
+    pre-erase.
+  Remarks:
+    Pre-erased blocks that aren't written before the stream is stopped have
+    undefined contents.  Only pre-erase sectors that are going to be written,
+    e.g. the clusters reserved for a file.
+*******************************************************************************/
+bool FILEIO_SD_WriteStreamStart(FILEIO_SD_DRIVE_CONFIG * config, uint32_t sectorAddress, uint32_t preEraseCount);
+
+/*******************************************************************************
+  Function:
+    bool FILEIO_SD_WriteStreamPut (FILEIO_SD_DRIVE_CONFIG * config,
+        uint8_t * buffer)
+  Summary:
+    Writes the next sector of the open stream.
+  Conditions:
+    FILEIO_SD_CONFIG_WRITE_STREAM must be defined in sd_spi_config.h and a
+    stream must be open.
+  Input:
+    config - An SD Drive configuration structure pointer
+    buffer - The buffer with the 512 bytes to write.
+  Return Values:
+    true -  The card accepted the block and is ready for the next one.
+    false - The block was rejected or the card timed out, the stream is closed.
+  Side Effects:
+    None.
+  Description:
+    Sends a data block and waits while the card signals busy.
+  Remarks:
+    None.
+*******************************************************************************/
+bool FILEIO_SD_WriteStreamPut(FILEIO_SD_DRIVE_CONFIG * config, uint8_t * buffer);
+
+/*******************************************************************************
+  Function:
+    bool FILEIO_SD_WriteStreamStop (FILEIO_SD_DRIVE_CONFIG * config)
+  Summary:
+    Stops the open stream.
+  Conditions:
+    FILEIO_SD_CONFIG_WRITE_STREAM must be defined in sd_spi_config.h.
+  Input:
+    config - An SD Drive configuration structure pointer
+  Return Values:
+    true -  No stream was open, or the card finished the stream.
+    false - The card timed out.
+  Side Effects:
+    None.
+  Description:
+    Sends the stop token and waits until the card has stored the blocks of
+    the stream.  Call it when the written data has to be durable, e.g. when a
+    log file is synced or closed.
+  Remarks:
+    Reads and writes that don't continue the stream stop it as well.
+*******************************************************************************/
+bool FILEIO_SD_WriteStreamStop(FILEIO_SD_DRIVE_CONFIG * config);
+
 
 uint8_t FILEIO_SD_AsyncReadTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASYNC_IO*);
 uint8_t FILEIO_SD_AsyncWriteTasks(FILEIO_SD_DRIVE_CONFIG * config, FILEIO_SD_ASYNC_IO*);
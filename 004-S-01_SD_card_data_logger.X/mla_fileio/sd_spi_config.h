@@ -62,4 +62,31 @@ please contact mla_licensing@microchip.com
 // the presence of a card.
 //#define FILEIO_SD_CONFIG_MEDIA_SOFT_DETECT
 
+// Define FILEIO_SD_CONFIG_WRITE_BUSY_TIMING to measure how long the media stays
+// busy after each written block.  The application must provide the function
+// uint32_t FILEIO_SD_TimeGet (void), returning a free running time in
+// microseconds.  The busy time of the last write is returned by
+// FILEIO_SD_WriteBusyTimeGet().
+#define FILEIO_SD_CONFIG_WRITE_BUSY_TIMING
+
+// Define FILEIO_SD_CONFIG_WRITE_STREAM to keep a multi-block write (CMD25) open
+// between sector writes.  A write that continues the previous one starts a
+// stream, and following sequential writes only send their data block, without
+// command and response.  The stream is stopped (STOP_TRAN) by the next write
+// that isn't sequential, by a read, or by FILEIO_SD_WriteStreamStop().  The
+// last blocks of a stream may not be stored by the card until it is stopped,
+// so stop it when the data has to be durable.
+#define FILEIO_SD_CONFIG_WRITE_STREAM
+
+// After initialization the SPI clock is set to the fastest one at or below
+// both the TRAN_SPEED of the card's CSD and FILEIO_SD_CONFIG_SPI_CLOCK_MAX (Hz),
+// the limit of the board wiring and the SPI module.  The current clock is
+// returned by FILEIO_SD_SPIClockGet().
+#define FILEIO_SD_CONFIG_SPI_CLOCK_MAX              15000000ul
+
+// Define FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS to halve the SPI clock after
+// this many consecutive failed sector reads or writes, down to the clock of the
+// initialization sequence.  Initializing the media starts from the fastest clock
+// again.
+#define FILEIO_SD_CONFIG_SPI_CLOCK_STEP_DOWN_ERRORS 3
 
@@ -303,6 +303,9 @@ typedef union
 // Description: An approximation of the number of cycles per delay loop of overhead
 #define FILEIO_SD_DELAY_OVERHEAD        (uint8_t)5
 
+// Description: BRG of the fastest SPI clock at or below clock (Hz), SCK = Fp / (2 * (BRG + 1))
+#define FILEIO_SD_SPI_BRG(clock)        ((SYS_CLK_FrequencyPeripheralGet() + (2ul * (clock)) - 1) / (2ul * (clock)) - 1)
+
 // Description: An approximate calculation of how many times to loop to delay 1 ms in the Delayms function
 #define FILEIO_SD_MILLISECOND_DELAY     (uint16_t)((SYS_CLK_FrequencyInstructionGet()/FILEIO_SD_DELAY_PRESCALER/(uint16_t)1000) - FILEIO_SD_DELAY_OVERHEAD)
 
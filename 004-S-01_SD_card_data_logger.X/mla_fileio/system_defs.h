@@ -5,8 +5,10 @@
 #define DRV_SPI_CONFIG_V2_ENABLED
 
 // The File I/O library requires the user to define the system clock frequency (Hz)
-#define SYS_CLK_FrequencySystemGet()            60000000
+// Fosc, main() sets the PLL to 120 MHz
+#define SYS_CLK_FrequencySystemGet()            120000000ul
 // The File I/O library requires the user to define the peripheral clock frequency (Hz)
-#define SYS_CLK_FrequencyPeripheralGet()        SYS_CLK_FrequencySystemGet()
+// Fp, the SPI, UART and timer clock, is Fcy on this device
+#define SYS_CLK_FrequencyPeripheralGet()        SYS_CLK_FrequencyInstructionGet()
 // The File I/O library requires the user to define the instruction clock frequency (Hz)
 #define SYS_CLK_FrequencyInstructionGet()       (SYS_CLK_FrequencySystemGet() / 2)
\ No newline at end of file
@@ -57,17 +57,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=mla_fileio/drv_spi_16bit_v2.c mla_fileio/fileio.c mla_fileio/sd_spi.c debugprint.c main.c softwaretimer.c utl.c can.c candrv.c device_logger.c device_logger_descriptors.c flash.c sd_logger.c gps.c
+SOURCEFILES_QUOTED_IF_SPACED=mla_fileio/drv_spi_16bit_v2.c mla_fileio/fileio.c mla_fileio/sd_spi.c debugprint.c main.c softwaretimer.c utl.c can.c candrv.c device_logger.c device_logger_descriptors.c flash.c flash_nor.c flash_rtsp.c sd_logger.c gps.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/mla_fileio/drv_spi_16bit_v2.o ${OBJECTDIR}/mla_fileio/fileio.o ${OBJECTDIR}/mla_fileio/sd_spi.o ${OBJECTDIR}/debugprint.o ${OBJECTDIR}/main.o ${OBJECTDIR}/softwaretimer.o ${OBJECTDIR}/utl.o ${OBJECTDIR}/can.o ${OBJECTDIR}/candrv.o ${OBJECTDIR}/device_logger.o ${OBJECTDIR}/device_logger_descriptors.o ${OBJECTDIR}/flash.o ${OBJECTDIR}/sd_logger.o ${OBJECTDIR}/gps.o
-POSSIBLE_DEPFILES=${OBJECTDIR}/mla_fileio/drv_spi_16bit_v2.o.d ${OBJECTDIR}/mla_fileio/fileio.o.d ${OBJECTDIR}/mla_fileio/sd_spi.o.d ${OBJECTDIR}/debugprint.o.d ${OBJECTDIR}/main.o.d ${OBJECTDIR}/softwaretimer.o.d ${OBJECTDIR}/utl.o.d ${OBJECTDIR}/can.o.d ${OBJECTDIR}/candrv.o.d ${OBJECTDIR}/device_logger.o.d ${OBJECTDIR}/device_logger_descriptors.o.d ${OBJECTDIR}/flash.o.d ${OBJECTDIR}/sd_logger.o.d ${OBJECTDIR}/gps.o.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/mla_fileio/drv_spi_16bit_v2.o ${OBJECTDIR}/mla_fileio/fileio.o ${OBJECTDIR}/mla_fileio/sd_spi.o ${OBJECTDIR}/debugprint.o ${OBJECTDIR}/main.o ${OBJECTDIR}/softwaretimer.o ${OBJECTDIR}/utl.o ${OBJECTDIR}/can.o ${OBJECTDIR}/candrv.o ${OBJECTDIR}/device_logger.o ${OBJECTDIR}/device_logger_descriptors.o ${OBJECTDIR}/flash.o ${OBJECTDIR}/flash_nor.o ${OBJECTDIR}/flash_rtsp.o ${OBJECTDIR}/sd_logger.o ${OBJECTDIR}/gps.o
+POSSIBLE_DEPFILES=${OBJECTDIR}/mla_fileio/drv_spi_16bit_v2.o.d ${OBJECTDIR}/mla_fileio/fileio.o.d ${OBJECTDIR}/mla_fileio/sd_spi.o.d ${OBJECTDIR}/debugprint.o.d ${OBJECTDIR}/main.o.d ${OBJECTDIR}/softwaretimer.o.d ${OBJECTDIR}/utl.o.d ${OBJECTDIR}/can.o.d ${OBJECTDIR}/candrv.o.d ${OBJECTDIR}/device_logger.o.d ${OBJECTDIR}/device_logger_descriptors.o.d ${OBJECTDIR}/flash.o.d ${OBJECTDIR}/flash_nor.o.d ${OBJECTDIR}/flash_rtsp.o.d ${OBJECTDIR}/sd_logger.o.d ${OBJECTDIR}/gps.o.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/mla_fileio/drv_spi_16bit_v2.o ${OBJECTDIR}/mla_fileio/fileio.o ${OBJECTDIR}/mla_fileio/sd_spi.o ${OBJECTDIR}/debugprint.o ${OBJECTDIR}/main.o ${OBJECTDIR}/softwaretimer.o ${OBJECTDIR}/utl.o ${OBJECTDIR}/can.o ${OBJECTDIR}/candrv.o ${OBJECTDIR}/device_logger.o ${OBJECTDIR}/device_logger_descriptors.o ${OBJECTDIR}/flash.o ${OBJECTDIR}/sd_logger.o ${OBJECTDIR}/gps.o
+OBJECTFILES=${OBJECTDIR}/mla_fileio/drv_spi_16bit_v2.o ${OBJECTDIR}/mla_fileio/fileio.o ${OBJECTDIR}/mla_fileio/sd_spi.o ${OBJECTDIR}/debugprint.o ${OBJECTDIR}/main.o ${OBJECTDIR}/softwaretimer.o ${OBJECTDIR}/utl.o ${OBJECTDIR}/can.o ${OBJECTDIR}/candrv.o ${OBJECTDIR}/device_logger.o ${OBJECTDIR}/device_logger_descriptors.o ${OBJECTDIR}/flash.o ${OBJECTDIR}/flash_nor.o ${OBJECTDIR}/flash_rtsp.o ${OBJECTDIR}/sd_logger.o ${OBJECTDIR}/gps.o
 
 # Source Files
-SOURCEFILES=mla_fileio/drv_spi_16bit_v2.c mla_fileio/fileio.c mla_fileio/sd_spi.c debugprint.c main.c softwaretimer.c utl.c can.c candrv.c device_logger.c device_logger_descriptors.c flash.c sd_logger.c gps.c
+SOURCEFILES=mla_fileio/drv_spi_16bit_v2.c mla_fileio/fileio.c mla_fileio/sd_spi.c debugprint.c main.c softwaretimer.c utl.c can.c candrv.c device_logger.c device_logger_descriptors.c flash.c flash_nor.c flash_rtsp.c sd_logger.c gps.c
 
 
 CFLAGS=
@@ -178,6 +178,20 @@ ${OBJECTDIR}/flash.o: flash.c  nbproject/Makefile-${CND_CONF}.mk
 	${MP_CC} $(MP_EXTRA_CC_PRE)  flash.c  -o ${OBJECTDIR}/flash.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
 	@${FIXDEPS} "${OBJECTDIR}/flash.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
 	
+${OBJECTDIR}/flash_nor.o: flash_nor.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash_nor.o.d 
+	@${RM} ${OBJECTDIR}/flash_nor.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  flash_nor.c  -o ${OBJECTDIR}/flash_nor.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash_nor.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/flash_nor.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/flash_rtsp.o: flash_rtsp.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash_rtsp.o.d 
+	@${RM} ${OBJECTDIR}/flash_rtsp.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  flash_rtsp.c  -o ${OBJECTDIR}/flash_rtsp.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash_rtsp.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/flash_rtsp.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
 ${OBJECTDIR}/sd_logger.o: sd_logger.c  nbproject/Makefile-${CND_CONF}.mk
 	@${MKDIR} "${OBJECTDIR}" 
 	@${RM} ${OBJECTDIR}/sd_logger.o.d 
@@ -277,6 +291,20 @@ ${OBJECTDIR}/flash.o: flash.c  nbproject/Makefile-${CND_CONF}.mk
 	${MP_CC} $(MP_EXTRA_CC_PRE)  flash.c  -o ${OBJECTDIR}/flash.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
 	@${FIXDEPS} "${OBJECTDIR}/flash.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
 	
+${OBJECTDIR}/flash_nor.o: flash_nor.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash_nor.o.d 
+	@${RM} ${OBJECTDIR}/flash_nor.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  flash_nor.c  -o ${OBJECTDIR}/flash_nor.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash_nor.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/flash_nor.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/flash_rtsp.o: flash_rtsp.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash_rtsp.o.d 
+	@${RM} ${OBJECTDIR}/flash_rtsp.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  flash_rtsp.c  -o ${OBJECTDIR}/flash_rtsp.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash_rtsp.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/flash_rtsp.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
 ${OBJECTDIR}/sd_logger.o: sd_logger.c  nbproject/Makefile-${CND_CONF}.mk
 	@${MKDIR} "${OBJECTDIR}" 
 	@${RM} ${OBJECTDIR}/sd_logger.o.d 
@@ -10,10 +10,13 @@
 #include "sd_logger.h"
 #include "mla_fileio/fileio.h"
 #include "mla_fileio/sd_spi.h"
+#include "mla_fileio/sd_spi_config.h"
+#include "softwaretimer.h"
 #include "debugprint.h"
 #include <string.h>
 #include "utl.h"
 #include "device_logger_descriptors.h"
+#include "device_logger.h"
 
 // ********************************************************
 // * FILE IO AND SD CARD
@@ -41,6 +44,10 @@ FILEIO_SD_DRIVE_CONFIG sdCardMediaParameters =
     sd_logger_SdSpiConfigurePins             // User-specified function to configure the pins' TRIS bits.
 };
 
+static bool sd_logger_sector_read(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer);
+static bool sd_logger_sector_write(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer, bool allowWriteToZero);
+static bool sd_logger_sectors_write(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer, uint16_t sector_count, bool allowWriteToZero);
+
 // The gSDDrive structure allows the user to specify which set of driver functions should be used by the
 // FILEIO library to interface to the drive.
 // This structure must be maintained as long as the user wishes to access the specified drive.
@@ -50,9 +57,10 @@ const FILEIO_DRIVE_CONFIG gSdDrive =
     (FILEIO_DRIVER_MediaDetect)FILEIO_SD_MediaDetect,                       // Function to detect that the media is inserted.
     (FILEIO_DRIVER_MediaInitialize)FILEIO_SD_MediaInitialize,               // Function to initialize the media.
     (FILEIO_DRIVER_MediaDeinitialize)FILEIO_SD_MediaDeinitialize,           // Function to de-initialize the media.
-    (FILEIO_DRIVER_SectorRead)FILEIO_SD_SectorRead,                         // Function to read a sector from the media.
-    (FILEIO_DRIVER_SectorWrite)FILEIO_SD_SectorWrite,                       // Function to write a sector to the media.
+    (FILEIO_DRIVER_SectorRead)sd_logger_sector_read,                        // Function to read a sector from the media.
+    (FILEIO_DRIVER_SectorWrite)sd_logger_sector_write,                      // Function to write a sector to the media.
     (FILEIO_DRIVER_WriteProtectStateGet)FILEIO_SD_WriteProtectStateGet,     // Function to determine if the media is write-protected.
+    (FILEIO_DRIVER_SectorsWrite)sd_logger_sectors_write,                    // Function to write consecutive sectors to the media.
 };
 
 #define SD_PIN_ANSEL_CS     ANSELBbits.ANSB0
@@ -152,6 +160,77 @@ void GetTimestamp (FILEIO_TIMESTAMP * timeStamp)
     timeStamp->date.bitfield.year = 20;
 }
 
+static sd_logger_stats_t sd_logger_stats;
+static sd_logger_timing_t sd_logger_timing;
+// Bytes per sample of the write rate
+#define SD_LOGGER_RATE_BYTES    4096
+static uint32_t sd_logger_rate_bytes = 0;
+static uint32_t sd_logger_rate_us = 0;
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+// Since the previous sd_logger_collect_timing()
+static uint32_t sd_logger_window_write_max_us = 0;
+static uint32_t sd_logger_window_busy_max_us = 0;
+static uint32_t sd_logger_window_bytes = 0;
+static uint32_t sd_logger_window_us = 0;
+#endif
+
+#if defined(FILEIO_SD_CONFIG_WRITE_BUSY_TIMING)
+uint32_t FILEIO_SD_TimeGet(void) {
+    return softwaretimer_get_time_us();
+}
+#endif
+
+// Set by a failed write, the card is not accessed any more until
+// sd_logger_media_task() has mounted it again
+static bool sd_logger_media_failed = false;
+
+// Count the sectors FILEIO transfers, to show the cost of syncs, and time
+// the writes
+static bool sd_logger_sector_read(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer) {
+    if (sd_logger_media_failed) {
+        return false;
+    }
+    sd_logger_stats.sector_reads++;
+    return FILEIO_SD_SectorRead(config, sector_addr, buffer);
+}
+
+static bool sd_logger_sector_write(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer, bool allowWriteToZero) {
+    return sd_logger_sectors_write(config, sector_addr, buffer, 1, allowWriteToZero);
+}
+
+static bool sd_logger_sectors_write(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer, uint16_t sector_count, bool allowWriteToZero) {
+    uint32_t start_us = softwaretimer_get_time_us();
+    uint32_t write_us;
+#if defined(FILEIO_SD_CONFIG_WRITE_BUSY_TIMING)
+    uint32_t busy_us;
+#endif
+    bool result;
+    
+    if (sd_logger_media_failed) {
+        return false;
+    }
+    sd_logger_stats.sector_writes += sector_count;
+    result = FILEIO_SD_SectorsWrite(config, sector_addr, buffer, sector_count, allowWriteToZero);
+    
+    write_us = softwaretimer_get_time_us() - start_us;
+    utl_histogram_add(&sd_logger_timing.sector_write_us, write_us);
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+    if (write_us > sd_logger_window_write_max_us) {
+        sd_logger_window_write_max_us = write_us;
+    }
+#endif
+#if defined(FILEIO_SD_CONFIG_WRITE_BUSY_TIMING)
+    busy_us = FILEIO_SD_WriteBusyTimeGet();
+    utl_histogram_add(&sd_logger_timing.busy_us, busy_us);
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+    if (busy_us > sd_logger_window_busy_max_us) {
+        sd_logger_window_busy_max_us = busy_us;
+    }
+#endif
+#endif
+    return result;
+}
+
 static int8_t sd_logger_fileio_init(void) {
     FILEIO_ERROR_TYPE error;
     // Initialize the library
@@ -175,6 +254,9 @@ static int8_t sd_logger_fileio_init(void) {
     error = FILEIO_DriveMount('A', &gSdDrive, &sdCardMediaParameters);
     if (error == FILEIO_ERROR_NONE) {
         debugprint_string("Successfully mounted the drive\r\n");
+        debugprint_string("SD SPI clock Hz: ");
+        debugprint_uint(FILEIO_SD_SPIClockGet());
+        debugprint_string("\r\n");
         return 0;
     } else {
         debugprint_string("Error mounting drive\r\n");
@@ -190,192 +272,1086 @@ static int8_t sd_logger_fileio_init(void) {
 // ********************************************************
 
 static uint32_t sd_logger_file_number = 0;
-static uint16_t sd_logger_file_bufs_written = 0;
+static uint32_t sd_logger_file_bufs_written = 0;
+// Bytes written to the current file, including the sector buffer
+static uint32_t sd_logger_file_size = 0;
+// Time since boot of the first record in the current file
+static uint32_t sd_logger_file_start_ms = 0;
+// Time since boot of the last record stored
+static uint32_t sd_logger_last_record_ms = 0;
+// Last record time and sector write count at the last sync
+static uint32_t sd_logger_sync_ms = 0;
+static uint32_t sd_logger_sync_sector_writes = 0;
+// Records stored while a card was ready, and how many of them were on the
+// card at the last successful sync
+static uint32_t sd_logger_records_stored = 0;
+static uint32_t sd_logger_records_synced = 0;
+#if defined(SD_LOGGER_ROTATE_SIZE)
+// SD_LOGGER_ROTATE_SIZE rounded down to whole clusters
+static uint32_t sd_logger_rotate_size = SD_LOGGER_ROTATE_SIZE;
+#endif
+static FILEIO_OBJECT sd_logger_file;
+#if !defined(SD_LOGGER_FORMAT_RAW)
+static bool sd_logger_file_is_open = false;
+// Set by the first record after a mount, from then on sd_logger_file_task()
+// opens the next file after a rotation
+static bool sd_logger_file_in_use = false;
+#if defined(SD_LOGGER_FILE_PREALLOCATE_SIZE)
+static bool sd_logger_file_is_preallocated = false;
+#endif
+#endif
 
+// Output is gathered into whole sectors before it is handed to FILEIO, so a
+// sector is written once instead of being read-modified-written per chunk.
+// The formatters append straight into this buffer through the cursor, its
+// size is the number of bytes left until the file reaches the next sector
+// boundary.
+#define SD_LOGGER_SECTOR_SIZE   FILEIO_CONFIG_MEDIA_SECTOR_SIZE
+static char sd_logger_sector_buffer[SD_LOGGER_SECTOR_SIZE];
+static void sd_logger_spill_cursor(utl_cursor_t *cursor);
+#if defined(SD_LOGGER_FORMAT_RAW)
+// The sector header goes in front of the data
+#define SD_LOGGER_RAW_DATA_SIZE (SD_LOGGER_SECTOR_SIZE - SD_LOGGER_RAW_HEADER_SIZE)
+static utl_cursor_t sd_logger_cursor = {
+    .buffer = sd_logger_sector_buffer + SD_LOGGER_RAW_HEADER_SIZE,
+    .length = 0,
+    .size = SD_LOGGER_RAW_DATA_SIZE,
+    .spill = sd_logger_spill_cursor
+};
+#else
+static utl_cursor_t sd_logger_cursor = {
+    .buffer = sd_logger_sector_buffer,
+    .length = 0,
+    .size = SD_LOGGER_SECTOR_SIZE,
+    .spill = sd_logger_spill_cursor
+};
+#endif
 
-static void sd_logger_find_free_file_number(void) {
-    uint32_t i;
-    char file_name[13];
+// CRC of the schema, see sd_logger_calc_layout_crc()
+static uint16_t sd_logger_layout_crc;
+
+
+#if !defined(SD_LOGGER_FORMAT_RAW)
+static void sd_logger_make_file_name(uint32_t number, char *file_name) {
     char temp[8];
-    FILEIO_OBJECT file;
-    
-    // find next free number in filename
-    for (i=0; i<99999; i++) {
-        strcpy(file_name, "LOG");
-        utl_uint32_to_string_len(i, temp, 10, 5);
-        strcat(file_name, temp);
-        strcat(file_name, ".CSV");
-        // Try to open file
-        if (FILEIO_Open(&file, file_name, FILEIO_OPEN_READ) != FILEIO_RESULT_SUCCESS) {
-            // Could not open file. Means the file is not yet there and we can use this number.
-            break;
+    
+    strcpy(file_name, "LOG");
+    utl_uint32_to_string_len(number, temp, 10, 5);
+    strcat(file_name, temp);
+    strcat(file_name, SD_LOGGER_FILE_EXTENSION);
+}
+
+// Returns the number of a LOGnnnnn file name, or -1 if the name doesn't match
+static int32_t sd_logger_parse_file_number(const char *file_name) {
+    uint8_t i;
+    int32_t number = 0;
+    
+    if (strncmp(file_name, "LOG", 3) != 0) {
+        return -1;
+    }
+    for (i = 3; i < 8; i++) {
+        if (file_name[i] < '0' || file_name[i] > '9') {
+            return -1;
+        }
+        number = number * 10 + (file_name[i] - '0');
+    }
+    return number;
+}
+
+static void sd_logger_find_free_file_number(void) {
+    FILEIO_SEARCH_RECORD record;
+    int32_t number;
+    uint32_t next = 0;
+    bool new_search = true;
+    
+    // Single pass over the root directory, continue after the highest
+    // existing number so boot time doesn't grow with the number of logs
+    while (FILEIO_Find("LOG?????" SD_LOGGER_FILE_EXTENSION, FILEIO_ATTRIBUTE_MASK, &record, new_search) == FILEIO_RESULT_SUCCESS) {
+        new_search = false;
+        number = sd_logger_parse_file_number((const char *)record.shortFileName);
+        if (number >= 0 && (uint32_t)number >= next) {
+            next = number + 1;
         }
-        FILEIO_Close (&file);
+    }
+    // All numbers used, keep appending to the last file
+    if (next > 99999) {
+        next = 99999;
     }
     
-    sd_logger_file_number = i;
+    sd_logger_file_number = next;
 }
 
-static void sd_logger_write_to_file(char *buffer, uint16_t buffer_length) {
-    FILEIO_OBJECT file;
+#if defined(SD_LOGGER_FILE_PREALLOCATE_SIZE)
+// The last file may have been open when the power failed or the card was
+// pulled, then its reserved clusters were never freed. Older files were
+// closed by the rotation.
+static void sd_logger_trim_last_file(void) {
     char file_name[13];
-    static uint8_t write_errors = 0;
-    char temp_string[16] = "";
     
-    // Write to file
-    strcpy(file_name, "LOG");
-    utl_uint32_to_string_len(sd_logger_file_number, temp_string, 10, 5);
-    strcat(file_name, temp_string);
-    strcat(file_name, ".CSV");
-    
-    if (FILEIO_Open(&file, file_name, FILEIO_OPEN_WRITE | FILEIO_OPEN_APPEND | FILEIO_OPEN_CREATE) != FILEIO_RESULT_SUCCESS) {
-        write_errors++;
-        if (write_errors > 16) {
-            asm("reset");
-        }
+    if (sd_logger_file_number == 0) {
+        return;
+    }
+    sd_logger_make_file_name(sd_logger_file_number - 1, file_name);
+    if (FILEIO_Open(&sd_logger_file, file_name, FILEIO_OPEN_WRITE) != FILEIO_RESULT_SUCCESS) {
         return;
-    }else {
-        write_errors = 0;
     }
-    FILEIO_Write (buffer, 1, buffer_length, &file);
-    FILEIO_Close (&file);
+    if (FILEIO_Trim(&sd_logger_file) != FILEIO_RESULT_SUCCESS) {
+        debugprint_string("Trimming last file failed\r\n");
+    }
+    FILEIO_Close(&sd_logger_file);
 }
+#endif
+#endif
 
-int8_t sd_logger_init(void) {
-    // Init sd card until success
-    int8_t res = sd_logger_fileio_init();
-    if (res == -1) {
-        return -1;
-    } 
-    // Successfully init filesystem
-    else {
-        sd_logger_find_free_file_number();
-        
-        debugprint_string("Using logfile ");
-        debugprint_uint(sd_logger_file_number);
-        debugprint_string("\r\n");
-        
+// The card is given up and mounted again by sd_logger_media_task(), records
+// since the last sync are then stored again by the caller of sd_logger_sync()
+static void sd_logger_write_error(void) {
+    sd_logger_media_failed = true;
+}
+
+// Log data written to the card and the time it took
+static void sd_logger_count_rate(uint16_t length, uint32_t write_us) {
+    sd_logger_rate_bytes += length;
+    sd_logger_rate_us += write_us;
+    if (sd_logger_rate_bytes >= SD_LOGGER_RATE_BYTES) {
+        if (sd_logger_rate_us != 0) {
+            utl_histogram_add(&sd_logger_timing.bytes_per_s, (uint64_t)sd_logger_rate_bytes * 1000000UL / sd_logger_rate_us);
+        }
+        sd_logger_rate_bytes = 0;
+        sd_logger_rate_us = 0;
+    }
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+    sd_logger_window_bytes += length;
+    sd_logger_window_us += write_us;
+#endif
+}
+
+// Sequential sector writes are streamed to the card as one multi-block write,
+// its last blocks are only stored once the stream is stopped
+static void sd_logger_stop_stream(void) {
+#if defined(FILEIO_SD_CONFIG_WRITE_STREAM)
+    if (!FILEIO_SD_WriteStreamStop(&sdCardMediaParameters)) {
+        sd_logger_write_error();
+    }
+#endif
+}
+
+#if !defined(SD_LOGGER_FORMAT_RAW)
+static int8_t sd_logger_open_file(void) {
+    char file_name[13];
+    
+    if (sd_logger_file_is_open) {
         return 0;
     }
+    
+    sd_logger_make_file_name(sd_logger_file_number, file_name);
+    if (FILEIO_Open(&sd_logger_file, file_name, FILEIO_OPEN_WRITE | FILEIO_OPEN_APPEND | FILEIO_OPEN_CREATE) != FILEIO_RESULT_SUCCESS) {
+        sd_logger_write_error();
+        return -1;
+    }
+    sd_logger_file_is_open = true;
+    sd_logger_file_in_use = true;
+#if defined(SD_LOGGER_FILE_PREALLOCATE_SIZE)
+    sd_logger_file_is_preallocated = false;
+#endif
+    return 0;
 }
 
-void sd_logger_store_logging_buffer(logging_buffer_t *buf) {
-    char log_string[256] = "";
-    char temp_string[16] = "";
-    uint16_t device_index, entry_index, data_index;
+#if defined(SD_LOGGER_FILE_PREALLOCATE_SIZE)
+// A step of its own after the open, the search in the FAT and the FAT
+// updates take several sector accesses
+static void sd_logger_preallocate_file(void) {
+    sd_logger_file_is_preallocated = true;
+    // Not fatal, without the reservation clusters are allocated while writing
+#if defined(SD_LOGGER_ROTATE_SIZE)
+    if (FILEIO_Preallocate(&sd_logger_file, sd_logger_rotate_size) != FILEIO_RESULT_SUCCESS) {
+#else
+    if (FILEIO_Preallocate(&sd_logger_file, SD_LOGGER_FILE_PREALLOCATE_SIZE) != FILEIO_RESULT_SUCCESS) {
+#endif
+        debugprint_string("Preallocation failed\r\n");
+    }
+}
+#endif
+
+static void sd_logger_flush_sector_buffer(void) {
+    uint16_t length = sd_logger_cursor.length;
+    uint32_t start_us, write_us;
     
-    // If this is first line of this file, write units
-    if (sd_logger_file_bufs_written == 0) {
-        strcpy(log_string, ";");
-        // Device names
-        for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
-            strcat(log_string, device_list[device_index].name);
-            for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
-                strcat(log_string, ";");
-                // Names are max 16 chars long + ; char + null char
-                if (strlen(log_string) >= (256 - 18)) {
-                    sd_logger_write_to_file(log_string, strlen(log_string));
-                    strcpy(log_string, "");
-                }
+    if (length == 0) {
+        return;
+    }
+    sd_logger_cursor.length = 0;
+    sd_logger_file_size += length;
+    if (sd_logger_open_file() != 0) {
+        return;
+    }
+    start_us = softwaretimer_get_time_us();
+    if (FILEIO_Write (sd_logger_sector_buffer, 1, length, &sd_logger_file) != length) {
+        sd_logger_write_error();
+        return;
+    }
+    write_us = softwaretimer_get_time_us() - start_us;
+    // FILEIO holds back a sector and writes FAT sectors now and then, so a
+    // single flush says little about the rate
+    sd_logger_count_rate(length, write_us);
+    // After a partial sector the next buffer is cut short so the file gets
+    // back on a sector boundary
+    sd_logger_cursor.size = SD_LOGGER_SECTOR_SIZE - (sd_logger_file.size % SD_LOGGER_SECTOR_SIZE);
+}
+
+static void sd_logger_close_file(void) {
+    sd_logger_flush_sector_buffer();
+    if (!sd_logger_file_is_open) {
+        return;
+    }
+    if (FILEIO_Close(&sd_logger_file) != FILEIO_RESULT_SUCCESS) {
+        sd_logger_file_is_open = false;
+        sd_logger_write_error();
+        return;
+    }
+    sd_logger_stop_stream();
+    sd_logger_file_is_open = false;
+    // A new file starts on a sector boundary
+    sd_logger_cursor.size = SD_LOGGER_SECTOR_SIZE;
+}
+#else
+// First sector and number of sectors of the ring, see SD_LOGGER_FORMAT_RAW
+static uint32_t sd_logger_raw_first_sector;
+static uint32_t sd_logger_raw_sector_count;
+// Tells the sectors of this ring apart from those of an earlier one that
+// was at the same place on the card
+static uint16_t sd_logger_raw_id;
+// Sequence number of the sector in the buffer
+static uint32_t sd_logger_raw_sequence;
+// Offset of the first record that starts in the buffer
+static uint16_t sd_logger_raw_first_record = SD_LOGGER_RAW_NO_RECORD;
+// Bytes of the buffer that are on the card already
+static uint16_t sd_logger_raw_written = 0;
+// The superblock shares the sector buffer, it is updated once the buffer is empty
+static bool sd_logger_raw_superblock_due = false;
+
+static uint16_t sd_logger_raw_get_uint16(const uint8_t *p) {
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t sd_logger_raw_get_uint32(const uint8_t *p) {
+    return (uint32_t)sd_logger_raw_get_uint16(p) | ((uint32_t)sd_logger_raw_get_uint16(p + 2) << 16);
+}
+
+static void sd_logger_raw_set_uint16(uint8_t *p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void sd_logger_raw_set_uint32(uint8_t *p, uint32_t value) {
+    sd_logger_raw_set_uint16(p, value & 0xFFFF);
+    sd_logger_raw_set_uint16(p + 2, value >> 16);
+}
+
+static uint32_t sd_logger_raw_sector_of(uint32_t sequence) {
+    return sd_logger_raw_first_sector + 1 + sequence % (sd_logger_raw_sector_count - 1);
+}
+
+static bool sd_logger_raw_superblock_ok(const uint8_t *sector) {
+    return memcmp(sector, SD_LOGGER_RAW_SUPER_MAGIC, 4) == 0 &&
+        sd_logger_raw_get_uint16(sector + 4) == SD_LOGGER_RAW_VERSION &&
+        sd_logger_raw_get_uint32(sector + 8) == sd_logger_raw_sector_count &&
+        sd_logger_raw_get_uint16(sector + 22) == utl_calc_crc((uint8_t *)sector, 22);
+}
+
+static bool sd_logger_raw_sector_ok(const uint8_t *sector, uint32_t sequence) {
+    uint16_t length = sd_logger_raw_get_uint16(sector + 10);
+    uint16_t crc;
+    
+    if (memcmp(sector, SD_LOGGER_RAW_SECTOR_MAGIC, 2) != 0 ||
+        sd_logger_raw_get_uint16(sector + 2) != sd_logger_raw_id ||
+        sd_logger_raw_get_uint32(sector + 4) != sequence ||
+        length > SD_LOGGER_RAW_DATA_SIZE) {
+        return false;
+    }
+    crc = utl_calc_crc((uint8_t *)sector, 14);
+    crc = utl_update_crc(crc, (uint8_t *)sector + SD_LOGGER_RAW_HEADER_SIZE, length);
+    return crc == sd_logger_raw_get_uint16(sector + 14);
+}
+
+// Only while the buffer is empty
+static void sd_logger_raw_write_superblock(void) {
+    uint8_t *sector = (uint8_t *)sd_logger_sector_buffer;
+    uint32_t data_sectors = sd_logger_raw_sector_count - 1;
+    uint32_t tail = 0;
+    
+    // The head sector is written next, until then the sector it replaces is
+    // the oldest one
+    if (sd_logger_raw_sequence >= data_sectors) {
+        tail = sd_logger_raw_sequence - data_sectors;
+    }
+    memset(sector, 0, SD_LOGGER_SECTOR_SIZE);
+    memcpy(sector, SD_LOGGER_RAW_SUPER_MAGIC, 4);
+    sd_logger_raw_set_uint16(sector + 4, SD_LOGGER_RAW_VERSION);
+    sd_logger_raw_set_uint16(sector + 6, sd_logger_raw_id);
+    sd_logger_raw_set_uint32(sector + 8, sd_logger_raw_sector_count);
+    sd_logger_raw_set_uint32(sector + 12, sd_logger_raw_sequence);
+    sd_logger_raw_set_uint32(sector + 16, tail);
+    sd_logger_raw_set_uint16(sector + 20, sd_logger_file_number);
+    sd_logger_raw_set_uint16(sector + 22, utl_calc_crc(sector, 22));
+    sd_logger_raw_superblock_due = false;
+    if (!sd_logger_sector_write(&sdCardMediaParameters, sd_logger_raw_first_sector, sector, false)) {
+        sd_logger_write_error();
+    }
+}
+
+static void sd_logger_raw_next_sector(void) {
+    sd_logger_raw_sequence++;
+    sd_logger_raw_first_record = SD_LOGGER_RAW_NO_RECORD;
+    sd_logger_raw_written = 0;
+    sd_logger_cursor.length = 0;
+    if (sd_logger_raw_superblock_due) {
+        sd_logger_raw_write_superblock();
+    }
+}
+
+// Writes the buffer to the sector of its sequence number. A sector that is
+// not full stays in the buffer and is written again with the next data.
+static void sd_logger_flush_sector_buffer(void) {
+    uint8_t *sector = (uint8_t *)sd_logger_sector_buffer;
+    uint16_t length = sd_logger_cursor.length;
+    uint16_t crc;
+    uint32_t start_us;
+    
+    if (length == sd_logger_raw_written) {
+        return;
+    }
+    memcpy(sector, SD_LOGGER_RAW_SECTOR_MAGIC, 2);
+    sd_logger_raw_set_uint16(sector + 2, sd_logger_raw_id);
+    sd_logger_raw_set_uint32(sector + 4, sd_logger_raw_sequence);
+    sd_logger_raw_set_uint16(sector + 8, sd_logger_file_number);
+    sd_logger_raw_set_uint16(sector + 10, length);
+    sd_logger_raw_set_uint16(sector + 12, sd_logger_raw_first_record);
+    crc = utl_calc_crc(sector, 14);
+    crc = utl_update_crc(crc, sector + SD_LOGGER_RAW_HEADER_SIZE, length);
+    sd_logger_raw_set_uint16(sector + 14, crc);
+    // Don't leave old data behind the end of a short sector
+    memset(sector + SD_LOGGER_RAW_HEADER_SIZE + length, 0, SD_LOGGER_RAW_DATA_SIZE - length);
+    
+    start_us = softwaretimer_get_time_us();
+    if (sd_logger_sectors_write(&sdCardMediaParameters, sd_logger_raw_sector_of(sd_logger_raw_sequence), sector, 1, false)) {
+        sd_logger_count_rate(length - sd_logger_raw_written, softwaretimer_get_time_us() - start_us);
+    } else {
+        sd_logger_write_error();
+    }
+    sd_logger_raw_written = length;
+    if (length == SD_LOGGER_RAW_DATA_SIZE) {
+        sd_logger_raw_next_sector();
+    }
+}
+
+// Keeps track of where the first record of a sector starts, so the records
+// of a sector can be found when the sector before it is lost
+static void sd_logger_raw_mark_record(void) {
+    if (sd_logger_cursor.length >= sd_logger_cursor.size) {
+        sd_logger_flush_sector_buffer();
+    }
+    if (sd_logger_raw_first_record == SD_LOGGER_RAW_NO_RECORD) {
+        sd_logger_raw_first_record = sd_logger_cursor.length;
+    }
+}
+
+// Ends the session, the next one starts in a new sector
+static void sd_logger_close_file(void) {
+    sd_logger_flush_sector_buffer();
+    if (sd_logger_cursor.length != 0) {
+        sd_logger_raw_next_sector();
+    }
+    sd_logger_raw_write_superblock();
+    sd_logger_stop_stream();
+}
+
+// Finds the ring in its file and continues behind the last sector written,
+// in a new session
+static int8_t sd_logger_raw_open(void) {
+    uint8_t *sector = (uint8_t *)sd_logger_sector_buffer;
+    uint32_t sequence = 0;
+    uint32_t i;
+    uint16_t session = 0;
+    
+    if (FILEIO_Open(&sd_logger_file, SD_LOGGER_RAW_FILE_NAME, FILEIO_OPEN_WRITE | FILEIO_OPEN_CREATE) != FILEIO_RESULT_SUCCESS) {
+        debugprint_string("Failed to open ring file\r\n");
+        return -1;
+    }
+    // Not fatal, the ring is then the longest contiguous part of the file
+    if (FILEIO_Preallocate(&sd_logger_file, SD_LOGGER_RAW_SIZE) != FILEIO_RESULT_SUCCESS) {
+        debugprint_string("Preallocation failed\r\n");
+    }
+    if (FILEIO_SectorRangeGet(&sd_logger_file, &sd_logger_raw_first_sector, &sd_logger_raw_sector_count) != FILEIO_RESULT_SUCCESS) {
+        FILEIO_Close(&sd_logger_file);
+        debugprint_string("Failed to find ring sectors\r\n");
+        return -1;
+    }
+    // Stores the size of the file, the ring is written without FILEIO from now on
+    if (FILEIO_Close(&sd_logger_file) != FILEIO_RESULT_SUCCESS || sd_logger_raw_sector_count < 2) {
+        debugprint_string("Failed to create ring file\r\n");
+        return -1;
+    }
+    
+    if (sd_logger_sector_read(&sdCardMediaParameters, sd_logger_raw_first_sector, sector) && sd_logger_raw_superblock_ok(sector)) {
+        sd_logger_raw_id = sd_logger_raw_get_uint16(sector + 6);
+        sequence = sd_logger_raw_get_uint32(sector + 12);
+        session = sd_logger_raw_get_uint16(sector + 20);
+        // Sectors written after the last superblock update
+        for (i = 1; i < sd_logger_raw_sector_count; i++) {
+            if (!sd_logger_sector_read(&sdCardMediaParameters, sd_logger_raw_sector_of(sequence), sector) ||
+                !sd_logger_raw_sector_ok(sector, sequence)) {
+                break;
+            }
+            if ((int16_t)(sd_logger_raw_get_uint16(sector + 8) - session) > 0) {
+                session = sd_logger_raw_get_uint16(sector + 8);
+            }
+            sequence++;
+            // A sector that is not full is the last one of its session
+            if (sd_logger_raw_get_uint16(sector + 10) != SD_LOGGER_RAW_DATA_SIZE) {
+                break;
             }
         }
-        strcat(log_string, "\r\nTimeSinceBoot;");
-        // Names are max 16 chars long + ; char + null char
-        if (strlen(log_string) >= (256 - 18)) {
-            sd_logger_write_to_file(log_string, strlen(log_string));
-            strcpy(log_string, "");
+        session++;
+    } else {
+        debugprint_string("Creating new ring\r\n");
+        sd_logger_raw_id = (uint16_t)softwaretimer_get_time_us() ^ sd_logger_layout_crc;
+    }
+    
+    sd_logger_raw_sequence = sequence;
+    sd_logger_file_number = session;
+    sd_logger_raw_first_record = SD_LOGGER_RAW_NO_RECORD;
+    sd_logger_raw_written = 0;
+    sd_logger_cursor.length = 0;
+    sd_logger_raw_write_superblock();
+    if (sd_logger_media_failed) {
+        return -1;
+    }
+    
+    debugprint_string("Ring sectors: ");
+    debugprint_uint(sd_logger_raw_sector_count);
+    debugprint_string(" head: ");
+    debugprint_uint(sd_logger_raw_sequence);
+    debugprint_string("\r\n");
+    return 0;
+}
+#endif
+
+static void sd_logger_spill_cursor(utl_cursor_t *cursor) {
+    (void)cursor;
+    sd_logger_flush_sector_buffer();
+}
+
+static void sd_logger_mark_synced(void) {
+    sd_logger_sync_ms = sd_logger_last_record_ms;
+    sd_logger_sync_sector_writes = sd_logger_stats.sector_writes;
+    sd_logger_records_synced = sd_logger_records_stored;
+}
+
+static enum {
+    SD_LOGGER_MEDIA_ABSENT,     // No card detected
+    SD_LOGGER_MEDIA_WAITING,    // Card detected, mounted when the wait is over
+    SD_LOGGER_MEDIA_MOUNTED
+} sd_logger_media_state = SD_LOGGER_MEDIA_ABSENT;
+static uint32_t sd_logger_media_wait_start_us = 0;
+static uint32_t sd_logger_media_wait_ms = 0;
+// Wait after the next failed mount
+static uint32_t sd_logger_media_retry_ms = SD_LOGGER_MOUNT_RETRY_MS;
+
+bool sd_logger_is_ready(void) {
+    return sd_logger_media_state == SD_LOGGER_MEDIA_MOUNTED && !sd_logger_media_failed;
+}
+
+int8_t sd_logger_sync(void) {
+    uint32_t sector_writes = sd_logger_stats.sector_writes;
+    uint16_t cost;
+    
+    if (!sd_logger_is_ready()) {
+        return -1;
+    }
+    sd_logger_flush_sector_buffer();
+#if defined(SD_LOGGER_FORMAT_RAW)
+    // Sectors behind the head in the superblock are found again at mount,
+    // keep that search short
+    sd_logger_raw_superblock_due = true;
+    if (sd_logger_cursor.length == 0) {
+        sd_logger_raw_write_superblock();
+    }
+    sd_logger_stop_stream();
+#else
+    if (sd_logger_file_is_open) {
+        // Write the cached data sector and update the size in the directory entry
+        if (FILEIO_Flush(&sd_logger_file) != FILEIO_RESULT_SUCCESS) {
+            sd_logger_write_error();
         }
-        // Data names
-        for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
-            for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
-                strcat(log_string, (device_list[device_index].msg_descr + entry_index)->name);
-                strcat(log_string, ";");
-                // Names are max 16 chars long + ; char + null char
-                if (strlen(log_string) >= (256 - 18)) {
-                    sd_logger_write_to_file(log_string, strlen(log_string));
-                    strcpy(log_string, "");
-                }
-            }
+        sd_logger_stop_stream();
+    }
+#endif
+    
+    cost = sd_logger_stats.sector_writes - sector_writes;
+    sd_logger_stats.syncs++;
+    sd_logger_stats.sync_sector_writes += cost;
+    if (cost > sd_logger_stats.sync_sector_writes_max) {
+        sd_logger_stats.sync_sector_writes_max = cost;
+    }
+    if (sd_logger_media_failed) {
+        return -1;
+    }
+    sd_logger_mark_synced();
+    // The card works, start over with short retries if it fails later
+    sd_logger_media_retry_ms = SD_LOGGER_MOUNT_RETRY_MS;
+    return 0;
+}
+
+static bool sd_logger_sync_due(void) {
+#if defined(SD_LOGGER_SYNC_INTERVAL_MS)
+    if (sd_logger_last_record_ms - sd_logger_sync_ms >= SD_LOGGER_SYNC_INTERVAL_MS) {
+        return true;
+    }
+#endif
+#if defined(SD_LOGGER_SYNC_SECTORS)
+    if (sd_logger_stats.sector_writes - sd_logger_sync_sector_writes >= SD_LOGGER_SYNC_SECTORS) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+void sd_logger_get_stats(sd_logger_stats_t *stats) {
+    *stats = sd_logger_stats;
+}
+
+static void sd_logger_print_histogram(const char *name, const utl_histogram_t *histogram) {
+    uint8_t i;
+    
+    debugprint_string((char *)name);
+    debugprint_string(" max: ");
+    debugprint_uint(histogram->max);
+    debugprint_string(" p50: ");
+    debugprint_uint(utl_histogram_percentile(histogram, 50));
+    debugprint_string(" p99: ");
+    debugprint_uint(utl_histogram_percentile(histogram, 99));
+    // Non empty buckets as lowest value:count
+    for (i = 0; i < UTL_HISTOGRAM_BUCKETS; i++) {
+        if (histogram->buckets[i] != 0) {
+            debugprint_string(" ");
+            debugprint_uint(i == 0 ? 0 : (uint32_t)1 << (i - 1));
+            debugprint_string(":");
+            debugprint_uint(histogram->buckets[i]);
         }
-        strcat(log_string, "\r\nms;");
-        // Names are max 16 chars long + ; char + null char
-        if (strlen(log_string) >= (256 - 18)) {
-            sd_logger_write_to_file(log_string, strlen(log_string));
-            strcpy(log_string, "");
+    }
+    debugprint_string("\r\n");
+}
+
+void sd_logger_print_timing(void) {
+    sd_logger_print_histogram("SD sector write us", &sd_logger_timing.sector_write_us);
+#if defined(FILEIO_SD_CONFIG_WRITE_BUSY_TIMING)
+    sd_logger_print_histogram("SD busy us", &sd_logger_timing.busy_us);
+#endif
+    sd_logger_print_histogram("SD bytes/s", &sd_logger_timing.bytes_per_s);
+    // Lower than at mount after repeated card errors
+    debugprint_string("SD SPI clock Hz: ");
+    debugprint_uint(FILEIO_SD_SPIClockGet());
+    debugprint_string("\r\n");
+}
+
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+static void sd_logger_collect_timing_value(uint16_t index, uint32_t value) {
+    can_msg_t msg;
+    
+    // Same layout as the messages of the devices on the bus
+    msg.frame.id = 0x180 | SD_TIMING_NODE_ID;
+    msg.frame.dlc = 8;
+    msg.frame.data0 = 0;
+    msg.frame.data1 = index & 0xFF;
+    msg.frame.data2 = index >> 8;
+    msg.frame.data3 = 0x01;
+    msg.frame.data4 = value & 0xFF;
+    msg.frame.data5 = (value >> 8) & 0xFF;
+    msg.frame.data6 = (value >> 16) & 0xFF;
+    msg.frame.data7 = value >> 24;
+    device_logger_decode_and_collect_can_message(msg);
+}
+
+void sd_logger_collect_timing(void) {
+    uint32_t rate = 0;
+    
+    if (sd_logger_window_us != 0) {
+        rate = (uint64_t)sd_logger_window_bytes * 1000000UL / sd_logger_window_us;
+    }
+    sd_logger_collect_timing_value(0x2000, sd_logger_window_write_max_us);
+    sd_logger_collect_timing_value(0x2001, utl_histogram_percentile(&sd_logger_timing.sector_write_us, 99));
+    sd_logger_collect_timing_value(0x2002, sd_logger_window_busy_max_us);
+    sd_logger_collect_timing_value(0x2003, rate);
+    
+    sd_logger_window_write_max_us = 0;
+    sd_logger_window_busy_max_us = 0;
+    sd_logger_window_bytes = 0;
+    sd_logger_window_us = 0;
+}
+#endif
+
+static void sd_logger_put_uint16(utl_cursor_t *cursor, uint16_t value) {
+    utl_cursor_put_char(cursor, value & 0xFF);
+    utl_cursor_put_char(cursor, value >> 8);
+}
+
+// Devices followed by the data entries in the order they appear in the
+// records. Written to binary files and used for the layout crc.
+static void sd_logger_put_schema(utl_cursor_t *cursor) {
+    uint16_t device_index, entry_index;
+    const data_entry_descriptor_t *descr;
+    
+    for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
+        utl_cursor_put_buffer(cursor, device_list[device_index].name, sizeof(device_list[device_index].name));
+        sd_logger_put_uint16(cursor, device_list[device_index].node_id);
+        sd_logger_put_uint16(cursor, device_list[device_index].msg_count);
+    }
+    for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
+        for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
+            descr = device_list[device_index].msg_descr + entry_index;
+            utl_cursor_put_buffer(cursor, descr->name, sizeof(descr->name));
+            utl_cursor_put_buffer(cursor, descr->unit, sizeof(descr->unit));
+            utl_cursor_put_char(cursor, descr->type);
         }
-        // Units
-        for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
-            for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
-                strcat(log_string, (device_list[device_index].msg_descr + entry_index)->unit);
-                strcat(log_string, ";");
-                // Names are max 16 chars long + ; char + null char
-                if (strlen(log_string) >= (256 - 18)) {
-                    sd_logger_write_to_file(log_string, strlen(log_string));
-                    strcpy(log_string, "");
+    }
+}
+
+static void sd_logger_spill_layout_crc(utl_cursor_t *cursor) {
+    sd_logger_layout_crc = utl_update_crc(sd_logger_layout_crc, (uint8_t *)cursor->buffer, cursor->length);
+    cursor->length = 0;
+}
+
+// The schema is fixed at build time, so its crc is calculated once and
+// written in every file header. Host tools use it to tell layouts apart.
+static void sd_logger_calc_layout_crc(void) {
+    char buffer[32];
+    utl_cursor_t cursor = {
+        .buffer = buffer,
+        .length = 0,
+        .size = sizeof(buffer),
+        .spill = sd_logger_spill_layout_crc
+    };
+    
+    sd_logger_layout_crc = UTL_CRC_INIT;
+    sd_logger_put_schema(&cursor);
+    sd_logger_spill_layout_crc(&cursor);
+}
+
+#if defined(SD_LOGGER_ROTATE_SIZE)
+static void sd_logger_init_rotate_size(void) {
+    uint32_t cluster_size = FILEIO_ClusterSizeGet('A');
+    
+    // Files end at a cluster boundary, at least one cluster per file
+    if (cluster_size == 0) {
+        return;
+    }
+    sd_logger_rotate_size = (SD_LOGGER_ROTATE_SIZE / cluster_size) * cluster_size;
+    if (sd_logger_rotate_size == 0) {
+        sd_logger_rotate_size = cluster_size;
+    }
+}
+#endif
+
+// Forgets the card without writing to it, another card may be in the slot
+// already. Cached sectors are dropped and the next record starts a new file.
+static void sd_logger_media_release(void) {
+    FILEIO_Reinitialize();
+    FILEIO_SD_MediaDeinitialize(&sdCardMediaParameters);
+#if !defined(SD_LOGGER_FORMAT_RAW)
+    sd_logger_file_is_open = false;
+    sd_logger_file_in_use = false;
+    sd_logger_cursor.size = SD_LOGGER_SECTOR_SIZE;
+#endif
+    sd_logger_cursor.length = 0;
+    sd_logger_file_bufs_written = 0;
+    sd_logger_file_size = 0;
+    // Records after the last sync are gone with the card
+    sd_logger_records_stored = sd_logger_records_synced;
+}
+
+static int8_t sd_logger_mount(void) {
+    sd_logger_media_failed = false;
+    if (sd_logger_fileio_init() != 0) {
+        sd_logger_media_release();
+        return -1;
+    }
+#if defined(SD_LOGGER_FORMAT_RAW)
+    if (sd_logger_raw_open() != 0) {
+        sd_logger_media_release();
+        return -1;
+    }
+    debugprint_string("Using session ");
+#else
+    sd_logger_find_free_file_number();
+#if defined(SD_LOGGER_FILE_PREALLOCATE_SIZE)
+    sd_logger_trim_last_file();
+#endif
+#if defined(SD_LOGGER_ROTATE_SIZE)
+    sd_logger_init_rotate_size();
+#endif
+    debugprint_string("Using logfile ");
+#endif
+    debugprint_uint(sd_logger_file_number);
+    debugprint_string("\r\n");
+    sd_logger_mark_synced();
+    return 0;
+}
+
+static void sd_logger_media_wait(uint32_t ms) {
+    sd_logger_media_state = SD_LOGGER_MEDIA_WAITING;
+    sd_logger_media_wait_start_us = softwaretimer_get_time_us();
+    sd_logger_media_wait_ms = ms;
+}
+
+// Backs off while the card keeps failing
+static void sd_logger_media_retry(void) {
+    sd_logger_media_wait(sd_logger_media_retry_ms);
+    if (sd_logger_media_retry_ms < SD_LOGGER_MOUNT_RETRY_MAX_MS) {
+        sd_logger_media_retry_ms *= 2;
+    }
+}
+
+void sd_logger_media_task(void) {
+    bool present = sd_logger_SdSpiGetCd();
+    
+    switch (sd_logger_media_state) {
+        case SD_LOGGER_MEDIA_MOUNTED:
+            if (!present || sd_logger_media_failed) {
+                debugprint_string(present ? "SD card failed\r\n" : "SD card removed\r\n");
+                sd_logger_stats.cards_lost++;
+                sd_logger_media_release();
+                if (present) {
+                    sd_logger_media_retry();
+                } else {
+                    sd_logger_media_state = SD_LOGGER_MEDIA_ABSENT;
+                }
+            }
+            break;
+            
+        case SD_LOGGER_MEDIA_ABSENT:
+            if (present) {
+                // Give the contacts and the supply of the card time to settle
+                debugprint_string("SD card inserted\r\n");
+                sd_logger_media_retry_ms = SD_LOGGER_MOUNT_RETRY_MS;
+                sd_logger_media_wait(SD_LOGGER_MOUNT_SETTLE_MS);
+            }
+            break;
+            
+        case SD_LOGGER_MEDIA_WAITING:
+            if (!present) {
+                sd_logger_media_state = SD_LOGGER_MEDIA_ABSENT;
+            } else if (softwaretimer_get_time_us() - sd_logger_media_wait_start_us >= sd_logger_media_wait_ms * 1000UL) {
+                if (sd_logger_mount() == 0) {
+                    sd_logger_media_state = SD_LOGGER_MEDIA_MOUNTED;
+                } else {
+                    sd_logger_media_retry();
                 }
             }
+            break;
+            
+        default:
+            sd_logger_media_state = SD_LOGGER_MEDIA_ABSENT;
+            break;
+    }
+}
+
+int8_t sd_logger_init(void) {
+    sd_logger_calc_layout_crc();
+    
+    if (sd_logger_mount() == 0) {
+        sd_logger_media_state = SD_LOGGER_MEDIA_MOUNTED;
+        return 0;
+    }
+    // sd_logger_media_task() mounts the card once it is detected
+    sd_logger_media_state = SD_LOGGER_MEDIA_ABSENT;
+    return -1;
+}
+
+#if defined(SD_LOGGER_FORMAT_CSV)
+static void sd_logger_write_csv_header(void) {
+    utl_cursor_t *cursor = &sd_logger_cursor;
+    uint16_t device_index, entry_index;
+    
+    // Layout crc in the otherwise empty cell above TimeSinceBoot
+    utl_cursor_put_string(cursor, "layout ");
+    utl_cursor_put_hex32(cursor, sd_logger_layout_crc);
+    utl_cursor_put_char(cursor, ';');
+    // Device names
+    for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
+        utl_cursor_put_string(cursor, device_list[device_index].name);
+        for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
+            utl_cursor_put_char(cursor, ';');
+        }
+    }
+    utl_cursor_put_string(cursor, "\r\nTimeSinceBoot;");
+    // Data names
+    for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
+        for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
+            utl_cursor_put_string(cursor, (device_list[device_index].msg_descr + entry_index)->name);
+            utl_cursor_put_char(cursor, ';');
         }
-        strcat(log_string, "\r\n");
-        sd_logger_write_to_file(log_string, strlen(log_string));
     }
+    utl_cursor_put_string(cursor, "status;\r\nms;");
+    // Units
+    for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
+        for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
+            utl_cursor_put_string(cursor, (device_list[device_index].msg_descr + entry_index)->unit);
+            utl_cursor_put_char(cursor, ';');
+        }
+    }
+    utl_cursor_put_string(cursor, ";\r\n");
+}
+
+static void sd_logger_write_csv_record(logging_buffer_t *buf, bool crc_ok) {
+    utl_cursor_t *cursor = &sd_logger_cursor;
+    uint16_t device_index, entry_index, data_index;
     
-    // Write buffer
-    strcpy(log_string, "");
     // Time since boot
-    utl_uint32_to_string(buf->time_since_boot_ms, temp_string, 10);
-    strcat(log_string, temp_string);
-    strcat(log_string, ";");
+    utl_cursor_put_uint32(cursor, buf->time_since_boot_ms);
+    utl_cursor_put_char(cursor, ';');
     // Data
     data_index = 0;
     for (device_index = 0; device_index < DEVICE_LIST_COUNT; device_index++) {
         for (entry_index = 0; entry_index < device_list[device_index].msg_count; entry_index++) {
             switch ((device_list[device_index].msg_descr + entry_index)->type) {
                 case UINT32:
-                    utl_uint32_to_string(buf->data[data_index].uint32, temp_string, 10);
+                    utl_cursor_put_uint32(cursor, buf->data[data_index].uint32);
                     break;
                 case INT32:
-                    utl_int32_to_string(buf->data[data_index].int32, temp_string, 10);
+                    utl_cursor_put_int32(cursor, buf->data[data_index].int32);
                     break;
                 case UINT16:
-                    utl_uint32_to_string(buf->data[data_index].uint16, temp_string, 10);
+                    utl_cursor_put_uint32(cursor, buf->data[data_index].uint16);
                     break;
                 case INT16:
-                    utl_int32_to_string(buf->data[data_index].int16, temp_string, 10);
+                    utl_cursor_put_int32(cursor, buf->data[data_index].int16);
                     break;
                 case UINT8:
-                    utl_uint32_to_string(buf->data[data_index].uint8, temp_string, 10);
+                    utl_cursor_put_uint32(cursor, buf->data[data_index].uint8);
                     break;
                 case INT8:
-                    utl_int32_to_string(buf->data[data_index].int8, temp_string, 10);
+                    utl_cursor_put_int32(cursor, buf->data[data_index].int8);
                     break;
                 case HEX32:
-                    utl_uint32_to_string(buf->data[data_index].hex32, temp_string, 16);
+                    utl_cursor_put_hex32(cursor, buf->data[data_index].hex32);
                     break;
                 case HEX16:
-                    utl_uint32_to_string(buf->data[data_index].hex16, temp_string, 16);
+                    utl_cursor_put_hex32(cursor, buf->data[data_index].hex16);
                     break;
                 case HEX8:
-                    utl_uint32_to_string(buf->data[data_index].hex8, temp_string, 16);
+                    utl_cursor_put_hex32(cursor, buf->data[data_index].hex8);
                     break;
             }
             data_index++;
-            strcat(log_string, temp_string);
-            strcat(log_string, ";");
-            // Data are max 10 chars long + ; char + null char
-            if (strlen(log_string) >= (256 - 18)) {
-                sd_logger_write_to_file(log_string, strlen(log_string));
-                strcpy(log_string, "");
+            utl_cursor_put_char(cursor, ';');
+        }
+    }
+    if (crc_ok) {
+        utl_cursor_put_string(cursor, "ok;\r\n");
+    } else {
+        utl_cursor_put_string(cursor, "crc error;\r\n");
+    }
+}
+#endif
+
+#if defined(SD_LOGGER_FORMAT_BINARY) || defined(SD_LOGGER_FORMAT_DELTA) || defined(SD_LOGGER_FORMAT_RAW)
+static void sd_logger_write_binary_header(void) {
+    // Schema block, all values are little endian and all strings are
+    // zero padded to their size in the descriptors
+    utl_cursor_put_buffer(&sd_logger_cursor, SD_LOGGER_BINARY_MAGIC, 4);
+    sd_logger_put_uint16(&sd_logger_cursor, SD_LOGGER_BINARY_VERSION);
+    sd_logger_put_uint16(&sd_logger_cursor, DEVICE_LIST_COUNT);
+    sd_logger_put_uint16(&sd_logger_cursor, LOGGING_BUFFER_LEN);
+    sd_logger_put_uint16(&sd_logger_cursor, LOGGING_BUFFER_RAW_8_LEN);
+    sd_logger_put_uint16(&sd_logger_cursor, sd_logger_layout_crc);
+    sd_logger_put_schema(&sd_logger_cursor);
+}
+#endif
+
+#if defined(SD_LOGGER_FORMAT_BINARY) || defined(SD_LOGGER_FORMAT_RAW)
+static void sd_logger_write_binary_record(logging_buffer_t *buf) {
+    // The record is written as it is in memory: time, data and crc
+    utl_cursor_put_buffer(&sd_logger_cursor, buf->raw_uint8, LOGGING_BUFFER_RAW_8_LEN);
+}
+#endif
+
+#if defined(SD_LOGGER_FORMAT_DELTA)
+// Last record written, deltas are taken against it
+static logging_buffer_t sd_logger_delta_previous;
+
+static void sd_logger_write_delta_record(logging_buffer_t *buf) {
+    uint8_t bitmap[SD_LOGGER_DELTA_BITMAP_LEN];
+    uint16_t i;
+    
+    if ((sd_logger_file_bufs_written % SD_LOGGER_DELTA_KEYFRAME_INTERVAL) == 0) {
+        // Keyframe, the whole record
+        utl_cursor_put_char(&sd_logger_cursor, SD_LOGGER_DELTA_KEYFRAME);
+        utl_cursor_put_buffer(&sd_logger_cursor, buf->raw_uint8, LOGGING_BUFFER_RAW_8_LEN);
+    } else {
+        // Bit i set when word i of the record changed, followed by the new
+        // value of each changed word
+        memset(bitmap, 0, sizeof(bitmap));
+        for (i = 0; i < LOGGING_BUFFER_RAW_32_LEN; i++) {
+            if (buf->raw_uint32[i] != sd_logger_delta_previous.raw_uint32[i]) {
+                bitmap[i >> 3] |= 1 << (i & 0x07);
             }
         }
+        utl_cursor_put_char(&sd_logger_cursor, SD_LOGGER_DELTA_RECORD);
+        utl_cursor_put_buffer(&sd_logger_cursor, bitmap, sizeof(bitmap));
+        for (i = 0; i < LOGGING_BUFFER_RAW_32_LEN; i++) {
+            if (bitmap[i >> 3] & (1 << (i & 0x07))) {
+                utl_cursor_put_buffer(&sd_logger_cursor, &buf->raw_uint32[i], 4);
+            }
+        }
+    }
+    memcpy(&sd_logger_delta_previous, buf, sizeof(sd_logger_delta_previous));
+}
+#endif
+
+// Largest record the selected format can produce
+#if defined(SD_LOGGER_FORMAT_CSV)
+// Time and every value as "-2147483648;", then "crc error;\r\n"
+#define SD_LOGGER_RECORD_SIZE_MAX   ((LOGGING_BUFFER_LEN + 1) * 12 + 12)
+#elif defined(SD_LOGGER_FORMAT_BINARY) || defined(SD_LOGGER_FORMAT_RAW)
+#define SD_LOGGER_RECORD_SIZE_MAX   LOGGING_BUFFER_RAW_8_LEN
+#elif defined(SD_LOGGER_FORMAT_DELTA)
+#define SD_LOGGER_RECORD_SIZE_MAX   (1 + SD_LOGGER_DELTA_BITMAP_LEN + LOGGING_BUFFER_RAW_8_LEN)
+#endif
+
+#if defined(SD_LOGGER_ROTATE_SIZE)
+// Whether the next record might not fit in the file
+static bool sd_logger_rotate_size_due(void) {
+    return sd_logger_file_bufs_written != 0 &&
+        sd_logger_file_size + sd_logger_cursor.length + SD_LOGGER_RECORD_SIZE_MAX > sd_logger_rotate_size;
+}
+#endif
+
+static bool sd_logger_rotate_due(logging_buffer_t *buf) {
+    if (sd_logger_file_bufs_written == 0) {
+        return false;
+    }
+#if defined(SD_LOGGER_ROTATE_SIZE)
+    if (sd_logger_rotate_size_due()) {
+        return true;
+    }
+#endif
+#if defined(SD_LOGGER_ROTATE_DURATION_MS)
+    if (buf->time_since_boot_ms - sd_logger_file_start_ms >= SD_LOGGER_ROTATE_DURATION_MS) {
+        return true;
+    }
+#else
+    (void)buf;
+#endif
+    return false;
+}
+
+void sd_logger_rotate(void) {
+    // Nothing written yet, keep using the current file
+    if (sd_logger_file_bufs_written == 0) {
+        return;
+    }
+    sd_logger_close_file();
+    // Closing the file synced it
+    if (!sd_logger_media_failed) {
+        sd_logger_mark_synced();
+    }
+    sd_logger_file_bufs_written = 0;
+    sd_logger_file_size = 0;
+    sd_logger_file_number++;
+}
+
+bool sd_logger_file_task(void) {
+    if (!sd_logger_is_ready()) {
+        return false;
+    }
+#if defined(SD_LOGGER_ROTATE_SIZE)
+    if (sd_logger_rotate_size_due()) {
+        sd_logger_rotate();
+        return true;
+    }
+#endif
+#if !defined(SD_LOGGER_FORMAT_RAW)
+    if (sd_logger_file_in_use && !sd_logger_file_is_open) {
+        sd_logger_open_file();
+        return true;
+    }
+#if defined(SD_LOGGER_FILE_PREALLOCATE_SIZE)
+    if (sd_logger_file_is_open && !sd_logger_file_is_preallocated) {
+        sd_logger_preallocate_file();
+        return true;
+    }
+#endif
+#endif
+    if (sd_logger_sync_due()) {
+        sd_logger_sync();
+        return true;
+    }
+    return false;
+}
+
+void sd_logger_store_logging_buffer(logging_buffer_t *buf) {
+    bool crc_ok;
+    
+    if (!sd_logger_is_ready()) {
+        return;
+    }
+    crc_ok = device_logger_check_crc(buf);
+    
+    // Catch records that got corrupted in staging
+    if (!crc_ok) {
+        sd_logger_stats.corrupt_records++;
+#if defined(SD_LOGGER_CORRUPT_RECORDS_SKIP) || defined(SD_LOGGER_FORMAT_DELTA)
+        sd_logger_records_stored++;
+        return;
+#elif !defined(SD_LOGGER_CORRUPT_RECORDS_FLAG)
+#error At least one corrupt record handling should be defined
+#endif
     }
-    strcat(log_string, "\r\n");
-    sd_logger_write_to_file(log_string, strlen(log_string));
+    
+    if (sd_logger_rotate_due(buf)) {
+        sd_logger_rotate();
+    }
+    if (sd_logger_file_bufs_written == 0) {
+        sd_logger_file_start_ms = buf->time_since_boot_ms;
+    }
+    
+#if defined(SD_LOGGER_FORMAT_CSV)
+    // If this is first line of this file, write names and units
+    if (sd_logger_file_bufs_written == 0) {
+        sd_logger_write_csv_header();
+    }
+    sd_logger_write_csv_record(buf, crc_ok);
+#elif defined(SD_LOGGER_FORMAT_BINARY)
+    // Every file starts with the schema so it can be decoded on its own
+    if (sd_logger_file_bufs_written == 0) {
+        sd_logger_write_binary_header();
+    }
+    sd_logger_write_binary_record(buf);
+#elif defined(SD_LOGGER_FORMAT_DELTA)
+    // Same schema as the binary format
+    if (sd_logger_file_bufs_written == 0) {
+        sd_logger_write_binary_header();
+    }
+    sd_logger_write_delta_record(buf);
+#elif defined(SD_LOGGER_FORMAT_RAW)
+    // A session starts with the schema, like a binary file
+    if (sd_logger_file_bufs_written == 0) {
+        sd_logger_raw_mark_record();
+        sd_logger_write_binary_header();
+    }
+    sd_logger_raw_mark_record();
+    sd_logger_write_binary_record(buf);
+#else
+#error At least one log format should be defined
+#endif
     
     // Increment buffers written to this file counter
     sd_logger_file_bufs_written++;
-    // When 100 buffers written, start new file
-    if (sd_logger_file_bufs_written >= 252) {
-        sd_logger_file_bufs_written = 0;
-        sd_logger_file_number++;
-    }
+    sd_logger_last_record_ms = buf->time_since_boot_ms;
+    sd_logger_records_stored++;
+}
+
+uint32_t sd_logger_get_records_synced(void) {
+    return sd_logger_records_synced;
 }
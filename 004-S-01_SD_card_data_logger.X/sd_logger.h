@@ -32,11 +32,193 @@
 #define	SD_LOGGER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "device_logger_descriptors.h"
+#include "utl.h"
 
+// Format of the log files.
+// Uncomment desired format
+#define SD_LOGGER_FORMAT_CSV
+//#define SD_LOGGER_FORMAT_BINARY
+//#define SD_LOGGER_FORMAT_DELTA
+//#define SD_LOGGER_FORMAT_RAW
+
+#if defined(SD_LOGGER_FORMAT_BINARY)
+// Binary files start with a schema block built from device_list followed by
+// the raw logging_buffer_t records. See tools/sd_log_decode.cpp.
+#define SD_LOGGER_FILE_EXTENSION    ".BIN"
+#define SD_LOGGER_BINARY_MAGIC      "SFLB"
+#define SD_LOGGER_BINARY_VERSION    2
+#elif defined(SD_LOGGER_FORMAT_DELTA)
+// Same schema block as the binary format. Records only hold the 32 bit words
+// of logging_buffer_t that changed since the previous record, behind a bitmap.
+// A full keyframe record starts every file and repeats every
+// SD_LOGGER_DELTA_KEYFRAME_INTERVAL records so decoding can resync.
+#define SD_LOGGER_FILE_EXTENSION    ".DLT"
+#define SD_LOGGER_BINARY_MAGIC      "SFLD"
+#define SD_LOGGER_BINARY_VERSION    2
+#define SD_LOGGER_DELTA_KEYFRAME_INTERVAL   16
+#define SD_LOGGER_DELTA_KEYFRAME    'K'
+#define SD_LOGGER_DELTA_RECORD      'D'
+#define SD_LOGGER_DELTA_BITMAP_LEN  ((LOGGING_BUFFER_RAW_32_LEN + 7) / 8)
+#elif defined(SD_LOGGER_FORMAT_RAW)
+// Same schema block and records as the binary format, appended to a ring of
+// sectors that are written straight to the card instead of through the FAT.
+// The ring is the longest contiguous run of SD_LOGGER_RAW_FILE_NAME, a file
+// of SD_LOGGER_RAW_SIZE bytes that is created once and then kept. Its first
+// sector is the superblock, the other sectors hold the data of one session
+// each behind a sector header. A session starts at every boot and at every
+// sd_logger_rotate(). When the ring is full the oldest sectors are
+// overwritten. See tools/sd_ring_extract.cpp.
+#define SD_LOGGER_BINARY_MAGIC      "SFLB"
+#define SD_LOGGER_BINARY_VERSION    2
+#define SD_LOGGER_RAW_FILE_NAME     "RING.RAW"
+#define SD_LOGGER_RAW_SIZE          (256UL * 1024UL * 1024UL)
+// Superblock, all values little endian:
+// magic, version, ring id, sector count of the ring, sequence number of the
+// head and tail sector, current session number, crc of the previous bytes
+#define SD_LOGGER_RAW_SUPER_MAGIC   "SFRS"
+#define SD_LOGGER_RAW_VERSION       1
+#define SD_LOGGER_RAW_SUPER_SIZE    24
+// Sector header:
+// magic, ring id, sequence number, session number, bytes of data behind the
+// header, offset in the data of the first record that starts in this sector
+// (SD_LOGGER_RAW_NO_RECORD if none), crc of the header and data.
+// Sequence number n is stored in sector 1 + n % (sector count - 1) of the
+// ring, the sector of the superblock is skipped.
+#define SD_LOGGER_RAW_SECTOR_MAGIC  "SR"
+#define SD_LOGGER_RAW_HEADER_SIZE   16
+#define SD_LOGGER_RAW_NO_RECORD     0xFFFF
+#else
+#define SD_LOGGER_FILE_EXTENSION    ".CSV"
+#endif
+
+// Records are checked against their crc before they are stored, corrupt ones
+// are counted in sd_logger_stats_t. CSV files have a status column with "ok"
+// or "crc error". The delta format always skips corrupt records, a decoder
+// can't tell them apart from a damaged file.
+// Uncomment desired handling
+//#define SD_LOGGER_CORRUPT_RECORDS_SKIP
+#define SD_LOGGER_CORRUPT_RECORDS_FLAG
+
+// Log file rotation. A new file is started before a record when one of the
+// limits is reached, or when sd_logger_rotate() is called.
+// Comment out a limit to disable it.
+// Bytes per file, rounded down to whole clusters of the card. The file is
+// closed when the next record might not fit, so its last cluster is full
+// except for less than one record.
+#define SD_LOGGER_ROTATE_SIZE               (128UL * 1024UL)
+// Maximum span of time since boot covered by one file
+//#define SD_LOGGER_ROTATE_DURATION_MS        (30UL * 60UL * 1000UL)
+
+// Clusters for a whole file are reserved when it is opened, so writes during
+// a save burst don't have to search the FAT. Unused clusters are freed when
+// the file is closed, or at the next mount when the power failed or the card
+// was pulled while it was open. With SD_LOGGER_ROTATE_SIZE the rotation size is
+// reserved, otherwise this many bytes. Comment out to disable preallocation.
+#define SD_LOGGER_FILE_PREALLOCATE_SIZE     (128UL * 1024UL)
+
+#if defined(SD_LOGGER_FORMAT_RAW)
+// The ring has no files to rotate by size or preallocate, a new session is
+// started by SD_LOGGER_ROTATE_DURATION_MS and sd_logger_rotate()
+#undef SD_LOGGER_ROTATE_SIZE
+#undef SD_LOGGER_FILE_PREALLOCATE_SIZE
+#endif
+
+// Durability of the open log file. Buffered data is written and the directory
+// entry updated when one of the limits is reached since the last sync, so a
+// power cut loses at most that much data. More frequent syncs cost extra
+// sector writes, see sd_logger_stats_t. Comment out a limit to disable it.
+// Span of time since boot of the records stored since the last sync
+#define SD_LOGGER_SYNC_INTERVAL_MS          (5UL * 1000UL)
+// Sectors written to the card since the last sync
+#define SD_LOGGER_SYNC_SECTORS              32
+
+// A card is mounted when it is inserted and given up when it is removed or a
+// write to it fails, by sd_logger_media_task(). The card detect pin must
+// show the card for SD_LOGGER_MOUNT_SETTLE_MS before it is mounted. A failed
+// mount is retried after SD_LOGGER_MOUNT_RETRY_MS, doubling up to
+// SD_LOGGER_MOUNT_RETRY_MAX_MS until a sync succeeds or the card is swapped.
+#define SD_LOGGER_MOUNT_SETTLE_MS           250UL
+#define SD_LOGGER_MOUNT_RETRY_MS            500UL
+#define SD_LOGGER_MOUNT_RETRY_MAX_MS        16000UL
+
+typedef struct {
+    uint32_t sector_reads;              // Sectors read from the card
+    uint32_t sector_writes;             // Sectors written to the card
+    uint32_t syncs;                     // Syncs of the open log file
+    uint32_t sync_sector_writes;        // Sectors written by those syncs
+    uint16_t sync_sector_writes_max;    // Sectors written by the most expensive sync
+    uint32_t corrupt_records;           // Records with a crc error
+    uint32_t cards_lost;                // Cards removed or given up after a write error
+} sd_logger_stats_t;
+
+// Timing of the card writes. Cards stall for up to hundreds of ms now and
+// then, the flash staging must hold the records gathered meanwhile.
+typedef struct {
+    utl_histogram_t sector_write_us;    // Time of each write to the card, of one sector or a run of them
+    utl_histogram_t busy_us;            // Part of it the card signalled busy
+    utl_histogram_t bytes_per_s;        // Rate of every 4 KB of log data, with the FAT and directory writes it caused
+} sd_logger_timing_t;
+
+// Returns -1 if no card could be mounted yet, sd_logger_media_task() keeps
+// trying
 int8_t sd_logger_init(void);
 
+// Watches the card detect pin, mounts an inserted card and gives up a removed
+// or failing one. Call this every main loop.
+void sd_logger_media_task(void);
+
+// True while a card is mounted and records can be stored
+bool sd_logger_is_ready(void);
+
+// Does one step of the work that is not tied to a record: closing a file
+// that is full, opening the next one, reserving its clusters, or a sync by
+// SD_LOGGER_SYNC_INTERVAL_MS and SD_LOGGER_SYNC_SECTORS. Call this every main
+// loop. Returns true when it used the card, store the next record in a later
+// loop then.
+bool sd_logger_file_task(void);
+
+// Records are ignored while no card is ready. A record costs up to two sector
+// writes, the first record of a file also opens it. The cpu waits while the
+// card is busy after each write, usually below a ms but up to
+// FILEIO_SD_WRITE_TIMEOUT, 0.35 to 0.7 s at a 15 MHz SPI clock, when the card
+// stalls. CAN frames that arrive meanwhile wait in the 24 receive buffers,
+// which last about 12 ms at full load of the 250 kbit/s bus.
 void sd_logger_store_logging_buffer(logging_buffer_t *buf);
 
+// Closes the current log file, the next record starts a new one. With
+// SD_LOGGER_FORMAT_RAW the next record starts a new session in the ring. Call
+// this on session events, main.c does when the gps date changes.
+void sd_logger_rotate(void);
+
+// Writes buffered data of the open log file to the card and updates its
+// directory entry. The file stays open for the next records. This is done
+// by sd_logger_file_task() according to SD_LOGGER_SYNC_INTERVAL_MS and
+// SD_LOGGER_SYNC_SECTORS.
+// Returns 0 when every record stored so far is on the card. Returns -1 when
+// the card was lost, the records since the last successful sync must then be
+// stored again once sd_logger_is_ready().
+int8_t sd_logger_sync(void);
+
+// Counts the records given to sd_logger_store_logging_buffer() while a card
+// was ready, skipped corrupt ones included. Returns how many of them were on
+// the card at the last successful sync, by sd_logger_file_task(), a rotation
+// or sd_logger_sync(). The records after it are lost when the card is, the
+// count then continues from here.
+uint32_t sd_logger_get_records_synced(void);
+
+void sd_logger_get_stats(sd_logger_stats_t *stats);
+
+// Prints max, p50, p99 and the buckets of the timing histograms, and the SPI
+// clock of the card
+void sd_logger_print_timing(void);
+
+#if defined(DEVICE_LOGGER_SD_TIMING_CHANNELS)
+// Puts the timing since the previous call in the SDCARD channels of the
+// collected data. Call before get_device_logger_collected_data().
+void sd_logger_collect_timing(void);
+#endif
+
 #endif	/* SD_LOGGER_H */
 
@@ -19,10 +19,15 @@ static volatile struct{
     uint8_t expired : 1;
 } softwaretimers[SOFTWARETIMER_MAX_TIMERS] = {};
 
+// Free running time base for softwaretimer_get_time_us()
+static volatile uint32_t softwaretimer_time_ms = 0;
+
 // Timer 1 interrupt. Triggers every 1 ms
 void __attribute__ ( ( interrupt, no_auto_psv ) ) _T3Interrupt(void) {
     uint8_t timer_number;
     
+    softwaretimer_time_ms++;
+    
     // Check all timers
     for (timer_number = 0; timer_number < SOFTWARETIMER_MAX_TIMERS; timer_number++) {
         // Skip non used and non running timers
@@ -181,3 +186,25 @@ int8_t softwaretimer_get_expired(uint8_t timer_number) {
         return 0;
     }
 }
+
+// Returns a free running time in us, for measuring durations. Made from the
+// 1 ms interrupt count and the timer 3 count, which runs at 7.5 MHz.
+// Wraps around after about 71 minutes, use unsigned subtraction.
+uint32_t softwaretimer_get_time_us(void) {
+    uint32_t ms;
+    uint16_t ticks;
+    uint8_t pending;
+    
+    // Read again when the interrupt ran in between
+    do {
+        ms = softwaretimer_time_ms;
+        ticks = TMR3;
+        pending = _T3IF;
+    } while (ms != softwaretimer_time_ms);
+    // Timer 3 rolled over but its interrupt didn't run yet
+    if (pending && ticks < (PR3 / 2)) {
+        ms++;
+    }
+    
+    return ms * 1000 + ((uint32_t)ticks * 2) / 15;
+}
@@ -78,4 +78,8 @@ int8_t softwaretimer_stop(uint8_t timer_number);
 //  -1 if the timer number was not a running timer or out of range.
 int8_t softwaretimer_get_expired(uint8_t timer_number);
 
+// Returns a free running time in us, for measuring durations.
+// Wraps around after about 71 minutes, use unsigned subtraction.
+uint32_t softwaretimer_get_time_us(void);
+
 #endif	/* SOFTWARETIMER_H */
@@ -1,5 +1,6 @@
 #include "utl.h"
 #include <stdint.h>
+#include <string.h>
 
 static const char hex_chars[] = "0123456789ABCDEF";
 
@@ -99,6 +100,109 @@ char *utl_uint32_to_string_len(uint32_t value, char *str, uint8_t radix, uint8_t
     return ptr;
 }
 
+// "00" to "99", used to convert two decimal digits at a time
+static const char utl_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * Function prototype:  UINT8 utl_uint32_to_dec(UINT32 value, char *str)
+ * Description:         Converts an unsigned integer to a null terminated decimal string
+ */
+uint8_t utl_uint32_to_dec(uint32_t value, char *str) {
+    const char *pair;
+    uint32_t high;
+    uint16_t low, digits;
+    uint8_t length;
+    char *ptr;
+
+    // Count the digits first so they can be written in place from the back
+    if (value < 10000) {
+        length = (value < 100) ? ((value < 10) ? 1 : 2) : ((value < 1000) ? 3 : 4);
+    } else if (value < 100000000) {
+        length = (value < 1000000) ? ((value < 100000) ? 5 : 6) : ((value < 10000000) ? 7 : 8);
+    } else {
+        length = (value < 1000000000) ? 9 : 10;
+    }
+    ptr = str + length;
+    *ptr = '\0';
+
+    // Split off blocks of 4 digits until the rest fits in 16 bits. This is
+    // the only 32-bit division, at most two times for the full range.
+    while (value > 0xFFFF) {
+        high = value / 10000;
+        low = value - high * 10000;
+        value = high;
+        digits = low / 100;
+        pair = utl_digit_pairs + 2 * (low - digits * 100);
+        *--ptr = pair[1];
+        *--ptr = pair[0];
+        pair = utl_digit_pairs + 2 * digits;
+        *--ptr = pair[1];
+        *--ptr = pair[0];
+    }
+    // Remaining part two digits at a time with 16-bit division
+    low = value;
+    while (low >= 100) {
+        digits = low / 100;
+        pair = utl_digit_pairs + 2 * (low - digits * 100);
+        *--ptr = pair[1];
+        *--ptr = pair[0];
+        low = digits;
+    }
+    if (low >= 10) {
+        pair = utl_digit_pairs + 2 * low;
+        *--ptr = pair[1];
+        *--ptr = pair[0];
+    } else {
+        *--ptr = '0' + low;
+    }
+    return length;
+}
+
+/**
+ * Function prototype:  UINT8 utl_int32_to_dec(INT32 value, char *str)
+ * Description:         Converts an integer to a null terminated decimal string
+ */
+uint8_t utl_int32_to_dec(int32_t value, char *str) {
+    if (value < 0) {
+        *str = '-';
+        // Negate as unsigned so INT32_MIN converts correctly
+        return utl_uint32_to_dec(0 - (uint32_t)value, str + 1) + 1;
+    }
+    return utl_uint32_to_dec(value, str);
+}
+
+/**
+ * Function prototype:  UINT8 utl_uint32_to_hex(UINT32 value, char *str)
+ * Description:         Converts an unsigned integer to a null terminated hex string
+ */
+uint8_t utl_uint32_to_hex(uint32_t value, char *str) {
+    uint8_t shift = 28, length = 0;
+
+    // Skip leading zero nibbles, keep at least one digit
+    while (shift != 0 && ((value >> shift) & 0xF) == 0) {
+        shift -= 4;
+    }
+    while (1) {
+        str[length++] = hex_chars[(value >> shift) & 0xF];
+        if (shift == 0) {
+            break;
+        }
+        shift -= 4;
+    }
+    str[length] = '\0';
+    return length;
+}
+
 /**
  * Function prototype:  char *utl_float_to_string(float value, char *str, UINT8 radix, UINT8 precision)
  * Description:         Converts an float to a null terminated string
@@ -203,46 +307,225 @@ int32_t utl_string_to_int32(char *str, uint8_t radix) {
     return value;
 }
 
-#define CRC_POLY_CRC16_CCITT 0x1021 // X^16 + X^12 + X^5 + 1
+// CRC 16 CCITT (X^16 + X^12 + X^5 + 1) of every byte value, so the crc is
+// updated with one lookup per byte instead of eight shift steps
+static const uint16_t utl_crc_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
 
 /**
- *     <b>Function prototype:</b><br>   static void hash_crc_16ccitt(WORD *crc,BYTE data)
- * <br>
- * <br><b>Description:</b><br>          Calculate CRC 16 CCITT
- * <br>
- * <br><b>Precondition:</b><br>         None
- * <br>
- * <br><b>Inputs:</b><br>               WORD *crc:  The crc to add this byte to
- * <br>                                 BYTE data:  byte to add on CRC
- * <br>
- * <br><b>Outputs:</b><br>              None
- * <br>
- * <br><b>Example:</b><br>              hash_crc_16ccitt(&wCrc,*pdata);
+ * Function prototype:  UINT16 utl_calc_crc(UINT8 *pdata, UINT32 ui_size)
+ * Description:         Calculates the CRC 16 CCITT of a byte array buffer.
  */
-static void hash_crc_16ccitt(uint16_t *crc,uint8_t data) {
-    uint8_t cnt;
-
-    *crc = ((uint16_t)data << 8) ^ *crc;
-    for (cnt = 0; cnt < 8; cnt++) {
-        if (*crc & 0x8000) {
-            *crc = (*crc << 1) ^ CRC_POLY_CRC16_CCITT;
-        } else {
-            *crc <<= 1;
-        }
-    }
+uint16_t utl_calc_crc(uint8_t *pdata, uint32_t ui_size) {
+   return utl_update_crc(UTL_CRC_INIT, pdata, ui_size);
 }
 
 /**
- * Function prototype:  UINT16 utl_calc_crc(UINT8 *pdata, UINT32 ui_size)
- * Description:         Calculates the CRC 16 CCITT of a byte array buffer.
+ * Function prototype:  UINT16 utl_update_crc(UINT16 crc, UINT8 *pdata, UINT32 ui_size)
+ * Description:         Adds a byte array buffer to a running CRC 16 CCITT.
  */
-uint16_t utl_calc_crc(uint8_t *pdata, uint32_t ui_size) {
-   int n=0;
-   uint16_t wCrc = 0x1D0F;
+uint16_t utl_update_crc(uint16_t crc, uint8_t *pdata, uint32_t ui_size) {
+   uint32_t n;
 
    for (n=0; n<ui_size ; n++) {
-      hash_crc_16ccitt(&wCrc,*pdata);
+      crc = (crc << 8) ^ utl_crc_table[(uint8_t)(crc >> 8) ^ *pdata];
       pdata++;
    }
-   return wCrc;
+   return crc;
+}
+
+/**
+ * Function prototype:  void utl_cursor_put_char(utl_cursor_t *cursor, char c)
+ * Description:         Appends a character at the cursor, spills the buffer when it is full
+ */
+void utl_cursor_put_char(utl_cursor_t *cursor, char c) {
+    if (cursor->length >= cursor->size) {
+        cursor->spill(cursor);
+    }
+    cursor->buffer[cursor->length++] = c;
+}
+
+/**
+ * Function prototype:  void utl_cursor_put_string(utl_cursor_t *cursor, const char *str)
+ * Description:         Appends a null terminated string at the cursor without the null char
+ */
+void utl_cursor_put_string(utl_cursor_t *cursor, const char *str) {
+    char *dest = cursor->buffer + cursor->length;
+    char *end = cursor->buffer + cursor->size;
+    
+    while (*str != '\0') {
+        if (dest == end) {
+            cursor->length = cursor->size;
+            cursor->spill(cursor);
+            dest = cursor->buffer + cursor->length;
+            end = cursor->buffer + cursor->size;
+        }
+        *dest++ = *str++;
+    }
+    cursor->length = dest - cursor->buffer;
+}
+
+/**
+ * Function prototype:  void utl_cursor_put_buffer(utl_cursor_t *cursor, const void *data, uint16_t length)
+ * Description:         Appends length bytes at the cursor
+ */
+void utl_cursor_put_buffer(utl_cursor_t *cursor, const void *data, uint16_t length) {
+    const char *src = data;
+    uint16_t count;
+    
+    while (length != 0) {
+        if (cursor->length >= cursor->size) {
+            cursor->spill(cursor);
+        }
+        count = cursor->size - cursor->length;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(cursor->buffer + cursor->length, src, count);
+        cursor->length += count;
+        src += count;
+        length -= count;
+    }
+}
+
+/**
+ * Function prototype:  UINT8 utl_cursor_put_uint32(utl_cursor_t *cursor, UINT32 value)
+ * Description:         Appends an unsigned integer as decimal text at the cursor
+ */
+uint8_t utl_cursor_put_uint32(utl_cursor_t *cursor, uint32_t value) {
+    char temp[11];
+    uint8_t length;
+    
+    // Max 10 digits and the null char of the converter
+    if (cursor->size - cursor->length >= 11) {
+        length = utl_uint32_to_dec(value, cursor->buffer + cursor->length);
+        cursor->length += length;
+    } else {
+        length = utl_uint32_to_dec(value, temp);
+        utl_cursor_put_buffer(cursor, temp, length);
+    }
+    return length;
+}
+
+/**
+ * Function prototype:  UINT8 utl_cursor_put_int32(utl_cursor_t *cursor, INT32 value)
+ * Description:         Appends an integer as decimal text at the cursor
+ */
+uint8_t utl_cursor_put_int32(utl_cursor_t *cursor, int32_t value) {
+    char temp[12];
+    uint8_t length;
+    
+    // Max minus sign, 10 digits and the null char of the converter
+    if (cursor->size - cursor->length >= 12) {
+        length = utl_int32_to_dec(value, cursor->buffer + cursor->length);
+        cursor->length += length;
+    } else {
+        length = utl_int32_to_dec(value, temp);
+        utl_cursor_put_buffer(cursor, temp, length);
+    }
+    return length;
+}
+
+/**
+ * Function prototype:  UINT8 utl_cursor_put_hex32(utl_cursor_t *cursor, UINT32 value)
+ * Description:         Appends an unsigned integer as hex text at the cursor
+ */
+uint8_t utl_cursor_put_hex32(utl_cursor_t *cursor, uint32_t value) {
+    char temp[9];
+    uint8_t length;
+    
+    // Max 8 digits and the null char of the converter
+    if (cursor->size - cursor->length >= 9) {
+        length = utl_uint32_to_hex(value, cursor->buffer + cursor->length);
+        cursor->length += length;
+    } else {
+        length = utl_uint32_to_hex(value, temp);
+        utl_cursor_put_buffer(cursor, temp, length);
+    }
+    return length;
+}
+
+/**
+ * Function prototype:  void utl_histogram_add(utl_histogram_t *histogram, UINT32 value)
+ * Description:         Counts a value in its log2 bucket and updates the maximum
+ */
+void utl_histogram_add(utl_histogram_t *histogram, uint32_t value) {
+    uint8_t bucket = 0;
+    uint8_t i;
+    uint32_t rest = value;
+    
+    // Bucket is the number of significant bits
+    while (rest != 0 && bucket < UTL_HISTOGRAM_BUCKETS - 1) {
+        rest >>= 1;
+        bucket++;
+    }
+    if (histogram->buckets[bucket] == UINT16_MAX) {
+        for (i = 0; i < UTL_HISTOGRAM_BUCKETS; i++) {
+            histogram->buckets[i] >>= 1;
+        }
+    }
+    histogram->buckets[bucket]++;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+/**
+ * Function prototype:  UINT32 utl_histogram_percentile(const utl_histogram_t *histogram, UINT8 percent)
+ * Description:         Estimates a percentile of the counted values
+ */
+uint32_t utl_histogram_percentile(const utl_histogram_t *histogram, uint8_t percent) {
+    uint32_t total = 0, rank, count = 0;
+    uint8_t i;
+    
+    for (i = 0; i < UTL_HISTOGRAM_BUCKETS; i++) {
+        total += histogram->buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    // Rank of the value, rounded up
+    rank = (total * percent + 99) / 100;
+    for (i = 0; i < UTL_HISTOGRAM_BUCKETS - 1; i++) {
+        count += histogram->buckets[i];
+        if (count >= rank) {
+            break;
+        }
+    }
+    if (i == UTL_HISTOGRAM_BUCKETS - 1 || (((uint32_t)1 << i) - 1) > histogram->max) {
+        return histogram->max;
+    }
+    return ((uint32_t)1 << i) - 1;
 }
@@ -3,6 +3,36 @@
 
 #include <stdint.h>
 
+// Start value of the CRC 16 CCITT used by utl_calc_crc
+#define UTL_CRC_INIT 0x1D0F
+
+/**
+ * Append cursor into a fixed size character buffer.
+ * When the buffer is full the spill function is called. It must consume the
+ * buffer contents, set length back to 0 and may set a new size.
+ */
+typedef struct utl_cursor_s {
+    char *buffer;
+    uint16_t length;
+    uint16_t size;
+    void (*spill)(struct utl_cursor_s *cursor);
+} utl_cursor_t;
+
+// Number of buckets of utl_histogram_t, the last one holds all values of
+// 2^(UTL_HISTOGRAM_BUCKETS-2) and up
+#define UTL_HISTOGRAM_BUCKETS 24
+
+/**
+ * Histogram with log2 sized buckets. Bucket 0 counts the value 0, bucket n
+ * counts values from 2^(n-1) to 2^n-1. When a bucket count would overflow all
+ * counts are halved, so the shape is kept and older values weigh less.
+ * Clear with memset before use.
+ */
+typedef struct {
+    uint16_t buckets[UTL_HISTOGRAM_BUCKETS];
+    uint32_t max;
+} utl_histogram_t;
+
 /**
  *     <b>Function prototype:</b><br>   char *utl_uint32_to_string(UINT32 value, char *str, UINT8 radix)
  * <br>
@@ -56,6 +86,57 @@ char *utl_int32_to_string(int32_t value, char *str, uint8_t radix);
  */
 char *utl_uint32_to_string_len(uint32_t value, char *str, uint8_t radix, uint8_t len);
 
+/**
+ *     <b>Function prototype:</b><br>   UINT8 utl_uint32_to_dec(UINT32 value, char *str)
+ * <br>
+ * <br><b>Description:</b><br>          Converts an unsigned integer to a null terminated decimal string.
+ * <br>                                 Uses at most two 32-bit divisions, the rest is done two digits
+ * <br>                                 at a time with 16-bit math and a lookup table.
+ * <br>
+ * <br><b>Precondition:</b><br>         None
+ * <br>
+ * <br><b>Inputs:</b><br>               UINT32 value:   The value to convert
+ * <br>                                 char *str:      Pointer to a string buffer of at least 11 chars
+ * <br>
+ * <br><b>Outputs:</b><br>              Number of characters written, without the null char
+ * <br>
+ * <br><b>Example:</b><br>              len = utl_uint32_to_dec(456, temp_str);    //Convert to string
+ */
+uint8_t utl_uint32_to_dec(uint32_t value, char *str);
+
+/**
+ *     <b>Function prototype:</b><br>   UINT8 utl_int32_to_dec(INT32 value, char *str)
+ * <br>
+ * <br><b>Description:</b><br>          Converts an integer to a null terminated decimal string
+ * <br>
+ * <br><b>Precondition:</b><br>         None
+ * <br>
+ * <br><b>Inputs:</b><br>               INT32 value:    The value to convert
+ * <br>                                 char *str:      Pointer to a string buffer of at least 12 chars
+ * <br>
+ * <br><b>Outputs:</b><br>              Number of characters written, without the null char
+ * <br>
+ * <br><b>Example:</b><br>              len = utl_int32_to_dec(-456, temp_str);    //Convert to string
+ */
+uint8_t utl_int32_to_dec(int32_t value, char *str);
+
+/**
+ *     <b>Function prototype:</b><br>   UINT8 utl_uint32_to_hex(UINT32 value, char *str)
+ * <br>
+ * <br><b>Description:</b><br>          Converts an unsigned integer to a null terminated upper case hex
+ * <br>                                 string without leading zeros. Uses no division.
+ * <br>
+ * <br><b>Precondition:</b><br>         None
+ * <br>
+ * <br><b>Inputs:</b><br>               UINT32 value:   The value to convert
+ * <br>                                 char *str:      Pointer to a string buffer of at least 9 chars
+ * <br>
+ * <br><b>Outputs:</b><br>              Number of characters written, without the null char
+ * <br>
+ * <br><b>Example:</b><br>              len = utl_uint32_to_hex(0x1C8, temp_str);    //Convert to "1C8"
+ */
+uint8_t utl_uint32_to_hex(uint32_t value, char *str);
+
 /**
  * Function prototype:  
  * Description:         
@@ -125,5 +206,158 @@ int32_t utl_string_to_int32(char *str, uint8_t radix);
  */
 uint16_t utl_calc_crc(uint8_t *pdata, uint32_t ui_size);
 
+/**
+ *     <b>Function prototype:</b><br>   UINT16 utl_update_crc(UINT16 crc, UINT8 *pdata, UINT32 ui_size)
+ * <br>
+ * <br><b>Description:</b><br>          Adds a byte array buffer to a running CRC 16 CCITT. Start with
+ * <br>                                 UTL_CRC_INIT to get the same result as utl_calc_crc.
+ * <br>
+ * <br><b>Precondition:</b><br>         None
+ * <br>
+ * <br><b>Inputs:</b><br>               UINT16 crc:     The crc so far
+ * <br>                                 UINT8 *pdata:   Pointer to a byte buffer.
+ * <br>                                 UINT32 ui_size: Size of the array
+ * <br>
+ * <br><b>Outputs:</b><br>              The updated crc
+ * <br>
+ * <br><b>Example:</b><br>              crc = utl_update_crc(crc, block, sizeof(block));
+ */
+uint16_t utl_update_crc(uint16_t crc, uint8_t *pdata, uint32_t ui_size);
+
+
+/**
+ *     <b>Function prototype:</b><br>   void utl_cursor_put_char(utl_cursor_t *cursor, char c)
+ * <br>
+ * <br><b>Description:</b><br>          Appends a character at the cursor, spills the buffer when it is full
+ * <br>
+ * <br><b>Precondition:</b><br>         Cursor initialized with a buffer, size and spill function
+ * <br>
+ * <br><b>Inputs:</b><br>               utl_cursor_t *cursor:   The cursor to write to
+ * <br>                                 char c:                 The character to append
+ * <br>
+ * <br><b>Outputs:</b><br>              None
+ * <br>
+ * <br><b>Example:</b><br>              utl_cursor_put_char(&cursor, ';');
+ */
+void utl_cursor_put_char(utl_cursor_t *cursor, char c);
+
+/**
+ *     <b>Function prototype:</b><br>   void utl_cursor_put_string(utl_cursor_t *cursor, const char *str)
+ * <br>
+ * <br><b>Description:</b><br>          Appends a null terminated string at the cursor without the null char.
+ * <br>                                 Spills the buffer as often as needed.
+ * <br>
+ * <br><b>Precondition:</b><br>         Cursor initialized with a buffer, size and spill function
+ * <br>
+ * <br><b>Inputs:</b><br>               utl_cursor_t *cursor:   The cursor to write to
+ * <br>                                 const char *str:        The string to append
+ * <br>
+ * <br><b>Outputs:</b><br>              None
+ * <br>
+ * <br><b>Example:</b><br>              utl_cursor_put_string(&cursor, "\r\n");
+ */
+void utl_cursor_put_string(utl_cursor_t *cursor, const char *str);
+
+/**
+ *     <b>Function prototype:</b><br>   void utl_cursor_put_buffer(utl_cursor_t *cursor, const void *data, uint16_t length)
+ * <br>
+ * <br><b>Description:</b><br>          Appends length bytes at the cursor. Spills the buffer as often as needed.
+ * <br>
+ * <br><b>Precondition:</b><br>         Cursor initialized with a buffer, size and spill function
+ * <br>
+ * <br><b>Inputs:</b><br>               utl_cursor_t *cursor:   The cursor to write to
+ * <br>                                 const void *data:       The bytes to append
+ * <br>                                 UINT16 length:          Number of bytes
+ * <br>
+ * <br><b>Outputs:</b><br>              None
+ * <br>
+ * <br><b>Example:</b><br>              utl_cursor_put_buffer(&cursor, buf.raw_uint8, LOGGING_BUFFER_RAW_8_LEN);
+ */
+void utl_cursor_put_buffer(utl_cursor_t *cursor, const void *data, uint16_t length);
+
+/**
+ *     <b>Function prototype:</b><br>   UINT8 utl_cursor_put_uint32(utl_cursor_t *cursor, UINT32 value)
+ * <br>
+ * <br><b>Description:</b><br>          Appends an unsigned integer as decimal text at the cursor.
+ * <br>                                 The digits are converted in place when the buffer has room.
+ * <br>
+ * <br><b>Precondition:</b><br>         Cursor initialized with a buffer, size and spill function
+ * <br>
+ * <br><b>Inputs:</b><br>               utl_cursor_t *cursor:   The cursor to write to
+ * <br>                                 UINT32 value:           The value to append
+ * <br>
+ * <br><b>Outputs:</b><br>              Number of characters appended
+ * <br>
+ * <br><b>Example:</b><br>              len = utl_cursor_put_uint32(&cursor, buf.time_since_boot_ms);
+ */
+uint8_t utl_cursor_put_uint32(utl_cursor_t *cursor, uint32_t value);
+
+/**
+ *     <b>Function prototype:</b><br>   UINT8 utl_cursor_put_int32(utl_cursor_t *cursor, INT32 value)
+ * <br>
+ * <br><b>Description:</b><br>          Appends an integer as decimal text at the cursor, with a minus
+ * <br>                                 sign when negative
+ * <br>
+ * <br><b>Precondition:</b><br>         Cursor initialized with a buffer, size and spill function
+ * <br>
+ * <br><b>Inputs:</b><br>               utl_cursor_t *cursor:   The cursor to write to
+ * <br>                                 INT32 value:            The value to append
+ * <br>
+ * <br><b>Outputs:</b><br>              Number of characters appended
+ * <br>
+ * <br><b>Example:</b><br>              len = utl_cursor_put_int32(&cursor, -456);
+ */
+uint8_t utl_cursor_put_int32(utl_cursor_t *cursor, int32_t value);
+
+/**
+ *     <b>Function prototype:</b><br>   UINT8 utl_cursor_put_hex32(utl_cursor_t *cursor, UINT32 value)
+ * <br>
+ * <br><b>Description:</b><br>          Appends an unsigned integer as upper case hex text at the cursor,
+ * <br>                                 without leading zeros
+ * <br>
+ * <br><b>Precondition:</b><br>         Cursor initialized with a buffer, size and spill function
+ * <br>
+ * <br><b>Inputs:</b><br>               utl_cursor_t *cursor:   The cursor to write to
+ * <br>                                 UINT32 value:           The value to append
+ * <br>
+ * <br><b>Outputs:</b><br>              Number of characters appended
+ * <br>
+ * <br><b>Example:</b><br>              len = utl_cursor_put_hex32(&cursor, 0x1C8);    //Appends "1C8"
+ */
+uint8_t utl_cursor_put_hex32(utl_cursor_t *cursor, uint32_t value);
+
+/**
+ *     <b>Function prototype:</b><br>   void utl_histogram_add(utl_histogram_t *histogram, UINT32 value)
+ * <br>
+ * <br><b>Description:</b><br>          Counts a value in its log2 bucket and updates the maximum
+ * <br>
+ * <br><b>Precondition:</b><br>         Histogram cleared
+ * <br>
+ * <br><b>Inputs:</b><br>               utl_histogram_t *histogram: The histogram to add to
+ * <br>                                 UINT32 value:               The value to count
+ * <br>
+ * <br><b>Outputs:</b><br>              None
+ * <br>
+ * <br><b>Example:</b><br>              utl_histogram_add(&write_time_us, end - start);
+ */
+void utl_histogram_add(utl_histogram_t *histogram, uint32_t value);
+
+/**
+ *     <b>Function prototype:</b><br>   UINT32 utl_histogram_percentile(const utl_histogram_t *histogram, UINT8 percent)
+ * <br>
+ * <br><b>Description:</b><br>          Estimates a percentile of the counted values. Returns the upper
+ * <br>                                 limit of the bucket it falls in, capped at the maximum. So the
+ * <br>                                 result is at most a factor 2 too high, never too low.
+ * <br>
+ * <br><b>Precondition:</b><br>         Histogram cleared
+ * <br>
+ * <br><b>Inputs:</b><br>               const utl_histogram_t *histogram:   The histogram
+ * <br>                                 UINT8 percent:                      The percentile, 1 to 100
+ * <br>
+ * <br><b>Outputs:</b><br>              The estimated percentile, 0 for an empty histogram
+ * <br>
+ * <br><b>Example:</b><br>              p99 = utl_histogram_percentile(&write_time_us, 99);
+ */
+uint32_t utl_histogram_percentile(const utl_histogram_t *histogram, uint8_t percent);
 
 #endif
@@ -0,0 +1,126 @@
+/*
+ * fat_alloc_bench - counts the FAT traffic of writing large files with fileio.c
+ *
+ * Writes one or more files of the given size through the MLA fileio.c of the
+ * firmware on a FAT32 image made by tools/host/mkfat.py. With several files
+ * the sectors are written to each file in turn, so their clusters interleave
+ * in the FAT. Counts the sectors read and the sectors written in the FAT,
+ * which is what FILEIO_CONFIG_FAT_CACHE_SECTORS in fileio_config.h changes.
+ *
+ * usage: fat_alloc_bench image megabytes [files] [preallocate]
+ *   files        number of files written at the same time, 1 to 4
+ *   preallocate  1 to call FILEIO_Preallocate for the full size first
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mla_fileio/fileio.h"
+#include "mla_fileio/sd_spi.h"
+#include "host/sd_image.h"
+
+#define FAT_ALLOC_BENCH_FILES_MAX 4
+
+static FILEIO_SD_DRIVE_CONFIG sd_config;
+
+// The write functions of the driver table return uint8_t, those of sd_spi.c
+// bool
+static uint8_t fat_alloc_bench_sector_write(void *config, uint32_t sector_addr, uint8_t *buffer, bool allowWriteToZero) {
+    return FILEIO_SD_SectorWrite(config, sector_addr, buffer, allowWriteToZero);
+}
+
+static uint8_t fat_alloc_bench_sectors_write(void *config, uint32_t sector_addr, uint8_t *buffer, uint16_t sectorCount, bool allowWriteToZero) {
+    return FILEIO_SD_SectorsWrite(config, sector_addr, buffer, sectorCount, allowWriteToZero);
+}
+
+static const FILEIO_DRIVE_CONFIG drive_config = {
+    (FILEIO_DRIVER_IOInitialize)FILEIO_SD_IOInitialize,
+    (FILEIO_DRIVER_MediaDetect)FILEIO_SD_MediaDetect,
+    (FILEIO_DRIVER_MediaInitialize)FILEIO_SD_MediaInitialize,
+    (FILEIO_DRIVER_MediaDeinitialize)FILEIO_SD_MediaDeinitialize,
+    (FILEIO_DRIVER_SectorRead)FILEIO_SD_SectorRead,
+    fat_alloc_bench_sector_write,
+    (FILEIO_DRIVER_WriteProtectStateGet)FILEIO_SD_WriteProtectStateGet,
+    fat_alloc_bench_sectors_write
+};
+
+static void fat_alloc_bench_timestamp(FILEIO_TIMESTAMP *timestamp) {
+    memset(timestamp, 0, sizeof(*timestamp));
+    timestamp->date.bitfield.day = 1;
+    timestamp->date.bitfield.month = 1;
+    timestamp->date.bitfield.year = 20;
+}
+
+int main(int argc, char **argv) {
+    static FILEIO_OBJECT files[FAT_ALLOC_BENCH_FILES_MAX];
+    static uint8_t sector[512];
+    uint32_t megabytes, s;
+    int file_count = 1, preallocate = 0, i;
+    long reads, writes, fat_writes;
+    char name[16];
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s image megabytes [files] [preallocate]\n", argv[0]);
+        return 2;
+    }
+    megabytes = (uint32_t)atol(argv[2]);
+    if (argc > 3) {
+        file_count = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        preallocate = atoi(argv[4]);
+    }
+    if (file_count < 1 || file_count > FAT_ALLOC_BENCH_FILES_MAX) {
+        fprintf(stderr, "files must be 1 to %d\n", FAT_ALLOC_BENCH_FILES_MAX);
+        return 2;
+    }
+
+    sd_image_open(argv[1]);
+    if (!FILEIO_Initialize()) {
+        fprintf(stderr, "FILEIO_Initialize failed\n");
+        return 1;
+    }
+    FILEIO_RegisterTimestampGet(fat_alloc_bench_timestamp);
+    if (FILEIO_DriveMount('A', &drive_config, &sd_config) != FILEIO_ERROR_NONE) {
+        fprintf(stderr, "FILEIO_DriveMount failed\n");
+        return 1;
+    }
+    // Only count the files, not the mount
+    reads = sd_image_reads;
+    writes = sd_image_writes;
+    fat_writes = sd_image_fat_writes;
+
+    for (i = 0; i < file_count; i++) {
+        sprintf(name, "BIG%d.BIN", i);
+        if (FILEIO_Open(&files[i], name, FILEIO_OPEN_WRITE | FILEIO_OPEN_CREATE | FILEIO_OPEN_TRUNCATE) != FILEIO_RESULT_SUCCESS) {
+            fprintf(stderr, "FILEIO_Open %s failed\n", name);
+            return 1;
+        }
+        if (preallocate && FILEIO_Preallocate(&files[i], megabytes * 1024UL * 1024UL) != FILEIO_RESULT_SUCCESS) {
+            fprintf(stderr, "FILEIO_Preallocate %s failed\n", name);
+            return 1;
+        }
+    }
+    for (s = 0; s < megabytes * 2048UL; s++) {
+        for (i = 0; i < file_count; i++) {
+            memset(sector, (uint8_t)(s + i), sizeof(sector));
+            if (FILEIO_Write(sector, 1, sizeof(sector), &files[i]) != sizeof(sector)) {
+                fprintf(stderr, "FILEIO_Write failed at sector %u\n", (unsigned)s);
+                return 1;
+            }
+        }
+    }
+    for (i = 0; i < file_count; i++) {
+        FILEIO_Close(&files[i]);
+    }
+
+    reads = sd_image_reads - reads;
+    writes = sd_image_writes - writes;
+    fat_writes = sd_image_fat_writes - fat_writes;
+    printf("FAT cache sectors %d, %u MB, %d file(s)%s\n", FILEIO_CONFIG_FAT_CACHE_SECTORS,
+            (unsigned)megabytes, file_count, preallocate ? ", preallocated" : "");
+    printf("reads %ld, writes %ld, FAT writes %ld, data writes %ld\n",
+            reads, writes, fat_writes, writes - fat_writes);
+    return 0;
+}
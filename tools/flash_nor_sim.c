@@ -0,0 +1,329 @@
+/*
+ * flash_nor_sim - runs the staging store of flash.c on a simulated SPI NOR part
+ *
+ * Replaces flash_nor.c with a part in ram that behaves like the real one:
+ * programming only clears bits, a page program wraps within its page and an
+ * erase sets a whole sector to 0xFF. The part can be loaded from and saved to
+ * an image file, so a run can continue where the previous one stopped.
+ *
+ * The program plays the logger: one record per second, saved to the "card" as
+ * soon as FLASH_LOW_WATERMARK records wait and released up to 14 at a time,
+ * with card outages and resets at random moments, also halfway through a
+ * program or an erase. Every record must come out in order; a record saved
+ * twice is only allowed after a reset, a record missing only when the
+ * overrun policy overwrote it.
+ *
+ * usage: flash_nor_sim [-i image] [-s seed] [-r resets] [-n steps]
+ */
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flash.h"
+#include "flash_nor.h"
+#include "utl.h"
+
+#if !defined(FLASH_STORE_NOR)
+#error "build flash_nor_sim with -DFLASH_STORE_NOR"
+#endif
+
+static uint8_t part[FLASH_NOR_SIZE];
+static uint32_t erase_count[FLASH_NOR_SECTOR_COUNT];
+static int busy_polls;
+static long programs, erases, program_violations, busy_waits;
+// A reset after this many programs and erases, 0 for none
+static long cut_after;
+static jmp_buf reset;
+
+// Kept outside main(), a reset jumps back into it
+// Id of the next record, and of the record expected on the card next
+static uint32_t next_id, card_id;
+static long step, stored, saved, again, dropped, damaged, lost, earlier;
+static long reset_count, outage;
+static bool after_reset;
+// Records from this id on the store keeps in ram until the erase is done, a
+// reset loses them
+static uint32_t pending_id;
+static bool pending;
+// The options and the run the records belong to
+static const char *image = NULL;
+static long resets = 20, steps = 20000;
+static uint32_t run;
+// Records the store took, any of them missing on the card is lost
+static bool *accepted;
+
+// flash.c prints a line at start up
+void debugprint_string(char *s) {
+    (void)s;
+}
+
+void debugprint_uint(uint32_t value) {
+    (void)value;
+}
+
+static void sim_cut_check(void) {
+    if (cut_after != 0 && --cut_after == 0) {
+        longjmp(reset, 1);
+    }
+}
+
+bool flash_nor_init(void) {
+    busy_polls = 0;
+    return true;
+}
+
+bool flash_nor_is_busy(void) {
+    if (busy_polls > 0) {
+        busy_polls--;
+        return true;
+    }
+    return false;
+}
+
+void flash_nor_read(uint32_t address, uint8_t *data, uint16_t length) {
+    if (address + length > FLASH_NOR_SIZE) {
+        fprintf(stderr, "read beyond the part at %u\n", (unsigned)address);
+        exit(1);
+    }
+    // The driver would wait for the erase
+    if (busy_polls > 0) {
+        busy_waits++;
+    }
+    busy_polls = 0;
+    memcpy(data, &part[address], length);
+}
+
+void flash_nor_program(uint32_t address, uint8_t *data, uint16_t length) {
+    uint32_t page, offset;
+    uint16_t i, done;
+
+    if (busy_polls > 0) {
+        busy_waits++;
+    }
+    busy_polls = 0;
+    for (i = 0; i < length; i += done) {
+        page = (address + i) / FLASH_NOR_PAGE_SIZE * FLASH_NOR_PAGE_SIZE;
+        offset = (address + i) % FLASH_NOR_PAGE_SIZE;
+        done = 0;
+        // The driver splits at page boundaries, wrap like the part would
+        // if it did not
+        while (i + done < length && offset < FLASH_NOR_PAGE_SIZE) {
+            if (cut_after == 1 && done == (length - i) / 2) {
+                // The reset hits halfway through this page
+                sim_cut_check();
+            }
+            if ((data[i + done] & ~part[page + offset]) != 0) {
+                program_violations++;
+            }
+            part[page + offset] &= data[i + done];
+            offset++;
+            done++;
+        }
+        programs++;
+        sim_cut_check();
+    }
+}
+
+void flash_nor_erase_sector(uint32_t address) {
+    uint32_t sector = address / FLASH_NOR_SECTOR_SIZE;
+
+    if (cut_after == 1) {
+        // An erase that is cut short leaves bits of the old data
+        for (uint32_t i = 0; i < FLASH_NOR_SECTOR_SIZE; i += 2) {
+            part[sector * FLASH_NOR_SECTOR_SIZE + i] = 0xFF;
+        }
+        sim_cut_check();
+    }
+    memset(&part[sector * FLASH_NOR_SECTOR_SIZE], 0xFF, FLASH_NOR_SECTOR_SIZE);
+    erase_count[sector]++;
+    erases++;
+    // 45 ms of main loops
+    busy_polls = 45;
+    sim_cut_check();
+}
+
+// The records count up in time_since_boot_ms, data[0] tells the runs of the
+// program apart and the rest follows from both
+static void make_record(logging_buffer_t *buf, uint32_t run, uint32_t id) {
+    uint16_t i;
+
+    buf->time_since_boot_ms = id;
+    buf->data[0].uint32 = run;
+    for (i = 1; i < LOGGING_BUFFER_LEN; i++) {
+        buf->data[i].uint32 = id * 2654435761u + i;
+    }
+    buf->crc = utl_calc_crc(buf->raw_uint8, LOGGING_BUFFER_RAW_8_LEN - 4);
+}
+
+static bool record_ok(logging_buffer_t *buf) {
+    logging_buffer_t expected;
+
+    make_record(&expected, buf->data[0].uint32, buf->time_since_boot_ms);
+    return memcmp(buf, &expected, sizeof(expected)) == 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned seed = 1;
+    logging_buffer_t buf;
+    uint16_t count, i, loop, overwritten;
+    flash_stats_t stats;
+    uint32_t dropped_before;
+    uint32_t id, min_erases, max_erases;
+    FILE *f;
+    int opt;
+
+    for (opt = 1; opt < argc - 1; opt += 2) {
+        if (strcmp(argv[opt], "-i") == 0) {
+            image = argv[opt + 1];
+        } else if (strcmp(argv[opt], "-s") == 0) {
+            seed = (unsigned)atoi(argv[opt + 1]);
+        } else if (strcmp(argv[opt], "-r") == 0) {
+            resets = atol(argv[opt + 1]);
+        } else if (strcmp(argv[opt], "-n") == 0) {
+            steps = atol(argv[opt + 1]);
+        }
+    }
+    srand(seed);
+    run = (uint32_t)time(NULL) ^ seed;
+    // A step cut short by a reset is done again with the next id
+    accepted = calloc(steps + resets + 1, sizeof(bool));
+
+    memset(part, 0xFF, sizeof(part));
+    if (image != NULL && (f = fopen(image, "rb")) != NULL) {
+        if (fread(part, 1, sizeof(part), f) != sizeof(part)) {
+            fprintf(stderr, "%s is not a %lu byte image\n", image, (unsigned long)sizeof(part));
+            return 1;
+        }
+        fclose(f);
+    }
+
+    if (setjmp(reset) != 0) {
+        reset_count++;
+        after_reset = true;
+        for (id = pending_id; pending && id < next_id; id++) {
+            accepted[id] = false;
+        }
+        pending = false;
+    }
+    cut_after = 0;
+    if (reset_count < resets) {
+        // Somewhere within the next steps
+        cut_after = 1 + rand() % (steps / resets * 4 + 1);
+    }
+    flash_init();
+
+    for (; step < steps; step++) {
+        // A step is one second of 1 ms main loops
+        count = flash_get_flash_number_of_data();
+        for (loop = 0; loop < 1000; loop++) {
+            flash_handler();
+        }
+        if (flash_get_flash_number_of_data() != count) {
+            pending = false;
+        }
+
+        // One record per step, when full the overrun policy decides. A
+        // record that was being stored at a reset may or may not be there.
+        id = next_id++;
+        flash_get_stats(&stats);
+        dropped_before = stats.dropped;
+        make_record(&buf, run, id);
+        count = flash_get_flash_number_of_data();
+        overwritten = flash_store_logging_data(&buf);
+        flash_get_stats(&stats);
+        if (stats.dropped != dropped_before) {
+            dropped++;
+        } else {
+            accepted[id] = true;
+            stored++;
+            if (flash_get_flash_number_of_data() + overwritten == count) {
+                if (!pending) {
+                    pending_id = id;
+                    pending = true;
+                }
+            } else {
+                pending = false;
+            }
+        }
+
+        // The card takes what waits, like main.c, or is away for a while
+        if (outage > 0) {
+            outage--;
+            continue;
+        }
+        if (rand() % 1000 == 0) {
+            outage = rand() % 20000;
+            continue;
+        }
+        // Like main.c, reads wait for a later step while the part erases
+        if (flash_is_busy()) {
+            continue;
+        }
+        count = flash_get_flash_number_of_data();
+        if (count < FLASH_LOW_WATERMARK) {
+            continue;
+        }
+        // A sync of the sd logger every 14 records at most
+        if (count > 14) {
+            count = 14;
+        }
+        for (i = 0; i < count; i++) {
+            if (!flash_get_flash_logging_data(&buf, i) || !record_ok(&buf)) {
+                // A record cut short by a reset
+                damaged++;
+                continue;
+            }
+            if (buf.data[0].uint32 != run) {
+                // Left in the image by an earlier run
+                earlier++;
+                continue;
+            }
+            if (buf.time_since_boot_ms < card_id) {
+                if (!after_reset) {
+                    fprintf(stderr, "step %ld: record %u saved twice\n", step, (unsigned)buf.time_since_boot_ms);
+                    return 1;
+                }
+                again++;
+                continue;
+            }
+            for (id = card_id; id < buf.time_since_boot_ms; id++) {
+                if (accepted[id]) {
+                    fprintf(stderr, "step %ld: record %u lost\n", step, (unsigned)id);
+                    lost++;
+                }
+            }
+            card_id = buf.time_since_boot_ms + 1;
+            saved++;
+        }
+        flash_release_data(count);
+        after_reset = false;
+    }
+
+    min_erases = max_erases = erase_count[0];
+    for (i = 1; i < FLASH_NOR_SECTOR_COUNT; i++) {
+        if (erase_count[i] < min_erases) {
+            min_erases = erase_count[i];
+        }
+        if (erase_count[i] > max_erases) {
+            max_erases = erase_count[i];
+        }
+    }
+    flash_get_stats(&stats);
+    printf("steps %ld resets %ld stored %ld saved %ld saved_again %ld damaged %ld dropped %ld overwritten %lu earlier_run %ld lost %ld\n",
+           step, reset_count, stored, saved, again, damaged, dropped, (unsigned long)stats.overwritten, earlier, lost);
+    printf("programs %ld erases %ld erases_per_sector %u..%u program_violations %ld busy_waits %ld\n",
+           programs, erases, (unsigned)min_erases, (unsigned)max_erases, program_violations, busy_waits);
+
+    if (image != NULL && (f = fopen(image, "wb")) != NULL) {
+        fwrite(part, 1, sizeof(part), f);
+        fclose(f);
+    }
+    // The counters start over at a reset, so only a run without resets
+    // tells exactly how many records were overwritten
+    return (lost > (long)stats.overwritten || program_violations != 0) ? 1 : 0;
+}
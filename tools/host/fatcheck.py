@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# fatcheck.py IMAGE [--list] [--extract DIR]
+# Checks a FAT32 image without partition table, as mkfat.py makes them, after
+# the firmware wrote to it: both FAT copies equal, no loops, cross links or
+# lost clusters, chains long enough for the file sizes. A chain longer than
+# the file is a preallocated file that was not closed. --extract writes the
+# files in the root directory to DIR.
+import struct, sys, os
+img=open(sys.argv[1],'rb').read()
+bps,spc,rsvd,nfat=struct.unpack_from('<HBHB',img,11)
+total=struct.unpack_from('<I',img,32)[0]; fatsz=struct.unpack_from('<I',img,36)[0]; rootc=struct.unpack_from('<I',img,44)[0]
+fat1=img[rsvd*512:(rsvd+fatsz)*512]; fat2=img[(rsvd+fatsz)*512:(rsvd+2*fatsz)*512]
+errors=[]
+if fat1!=fat2: errors.append("FAT copies differ")
+clusters=(total-rsvd-nfat*fatsz)//spc
+fat=struct.unpack_from('<%dI'%(clusters+2),fat1)
+fat=[v&0x0FFFFFFF for v in fat]
+data0=rsvd+nfat*fatsz; csize=spc*512
+def chain(c):
+    out=[]; seen=set()
+    while 2<=c<0x0FFFFFF8:
+        if c in seen: errors.append("loop at %d"%c); break
+        seen.add(c); out.append(c); c=fat[c]
+    return out
+def rd(c): o=(data0+(c-2)*spc)*512; return img[o:o+csize]
+used=set(chain(rootc)); files=[]
+rootdata=b''.join(rd(c) for c in chain(rootc))
+for i in range(0,len(rootdata),32):
+    e=rootdata[i:i+32]
+    if e[0]==0: break
+    if e[0]==0xE5 or e[11]&0x08 or e[11]==0x0F: continue
+    name=e[0:8].decode().strip()+'.'+e[8:11].decode().strip()
+    first=struct.unpack_from('<H',e,20)[0]<<16|struct.unpack_from('<H',e,26)[0]
+    size=struct.unpack_from('<I',e,28)[0]
+    ch=chain(first) if first else []
+    for c in ch:
+        if c in used: errors.append("%s cross-linked at %d"%(name,c))
+        used.add(c)
+    need=(size+csize-1)//csize
+    if len(ch)<need: errors.append("%s size %d needs %d clusters, chain has %d"%(name,size,need,len(ch)))
+    files.append((name,size,ch))
+lost=[c for c in range(2,clusters+2) if fat[c]!=0 and c not in used]
+if lost: errors.append("%d lost clusters"%len(lost))
+frag=sum(1 for n,s,ch in files for a,b in zip(ch,ch[1:]) if b!=a+1)
+print("files=%d fragments=%d used=%d"%(len(files),frag,len(used)))
+if '--extract' in sys.argv:
+    d=sys.argv[sys.argv.index('--extract')+1]; os.makedirs(d,exist_ok=True)
+    for n,s,ch in files:
+        open(os.path.join(d,n),'wb').write(b''.join(rd(c) for c in ch)[:s])
+if '--list' in sys.argv:
+    for n,s,ch in files: print(n,s,len(ch),"clusters")
+for e in errors: print("ERROR:",e)
+sys.exit(1 if errors else 0)
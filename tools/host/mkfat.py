@@ -0,0 +1,31 @@
+#!/usr/bin/env python3
+# mkfat.py IMAGE SIZE_MB [SECTORS_PER_CLUSTER]
+# Makes an empty FAT32 image without partition table, as a card formatted
+# without one. FAT32 needs at least 65525 clusters, 300 MB at 8 sectors per
+# cluster.
+import struct, sys
+path=sys.argv[1]; size_mb=int(sys.argv[2]); spc=int(sys.argv[3]) if len(sys.argv)>3 else 8
+total=size_mb*2048; rsvd=32; nfat=2
+fatsz=1
+while True:
+    clusters=(total-rsvd-nfat*fatsz)//spc
+    need=((clusters+2)*4+511)//512
+    if need<=fatsz: break
+    fatsz=need
+assert clusters>=65525, "too small for FAT32 (%d clusters)"%clusters
+bs=bytearray(512)
+bs[0:3]=b'\xEB\x58\x90'; bs[3:11]=b'MSWIN4.1'
+struct.pack_into('<HBHBHHBHHHII',bs,11,512,spc,rsvd,nfat,0,0,0xF8,0,63,255,0,total)
+struct.pack_into('<IHHIHH',bs,36,fatsz,0,0,2,1,6)
+bs[64]=0x80; bs[66]=0x29; struct.pack_into('<I',bs,67,0x12345678)
+bs[71:82]=b'NO NAME    '; bs[82:90]=b'FAT32   '; bs[510]=0x55; bs[511]=0xAA
+fsi=bytearray(512); struct.pack_into('<I',fsi,0,0x41615252); struct.pack_into('<I',fsi,484,0x61417272)
+struct.pack_into('<II',fsi,488,clusters-1,3); fsi[510]=0x55; fsi[511]=0xAA
+with open(path,'wb') as f:
+    f.truncate(total*512)
+    for base in (0,6):
+        f.seek((base)*512); f.write(bs); f.seek((base+1)*512); f.write(fsi)
+    fat=struct.pack('<III',0x0FFFFFF8,0x0FFFFFFF,0x0FFFFFFF)
+    for i in range(nfat):
+        f.seek((rsvd+i*fatsz)*512); f.write(fat)
+print("clusters=%d fatsz=%d spc=%d"%(clusters,fatsz,spc))
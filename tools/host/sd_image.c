@@ -0,0 +1,178 @@
+/*
+ * sd_image - the sd card of the firmware as an image file, for host tools
+ *
+ * Replaces mla_fileio/sd_spi.c below fileio.c: every sector read or write
+ * goes to the image, and is counted. Writes that land in the FAT are counted
+ * separately. Time only moves on when the card is used, a sector write takes
+ * 550 us plus a busy time of 300 to 800 us, with a 180 ms stall every 200
+ * writes like real cards have now and then.
+ *
+ * Also holds the debugprint and softwaretimer functions the firmware calls,
+ * debug output goes to stderr when sd_image_verbose is set.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sd_image.h"
+#include "mla_fileio/fileio.h"
+#include "mla_fileio/sd_spi.h"
+#include "xc.h"
+
+volatile host_bits_t ANSELBbits, ANSELAbits, TRISBbits, TRISAbits, LATBbits, PORTAbits;
+volatile uint16_t _SDI1R, _RP18R, _RP17R, OSCCON;
+
+long sd_image_reads, sd_image_writes, sd_image_fat_writes, sd_image_write_commands;
+int sd_image_verbose;
+
+static FILE *image;
+static uint32_t fat_start, fat_end;
+static uint32_t time_us, busy_us;
+static FILEIO_MEDIA_INFORMATION media_information;
+
+void sd_image_open(const char *path) {
+    uint8_t boot[512];
+    uint32_t fat_size;
+
+    image = fopen(path, "r+b");
+    if (image == NULL || fread(boot, 1, sizeof(boot), image) != sizeof(boot)) {
+        perror(path);
+        exit(1);
+    }
+    // FAT32 without a partition table, as mkfat.py makes them
+    memcpy(&fat_size, &boot[36], sizeof(fat_size));
+    fat_start = boot[14] | (boot[15] << 8);
+    fat_end = fat_start + boot[16] * fat_size;
+}
+
+void debugprint_string(char *s) {
+    if (sd_image_verbose) {
+        fputs(s, stderr);
+    }
+}
+
+void debugprint_char(char c) {
+    if (sd_image_verbose) {
+        fputc(c, stderr);
+    }
+}
+
+void debugprint_uint(uint32_t value) {
+    if (sd_image_verbose) {
+        fprintf(stderr, "%u", (unsigned)value);
+    }
+}
+
+void debugprint_int(int32_t value) {
+    if (sd_image_verbose) {
+        fprintf(stderr, "%d", (int)value);
+    }
+}
+
+void debugprint_hex(uint32_t value) {
+    if (sd_image_verbose) {
+        fprintf(stderr, "%X", (unsigned)value);
+    }
+}
+
+uint32_t softwaretimer_get_time_us(void) {
+    time_us += 3;
+    return time_us;
+}
+
+uint32_t FILEIO_SD_WriteBusyTimeGet(void) {
+    return busy_us;
+}
+
+void FILEIO_SD_IOInitialize(FILEIO_SD_DRIVE_CONFIG *config) {
+    (void)config;
+}
+
+bool FILEIO_SD_MediaDetect(FILEIO_SD_DRIVE_CONFIG *config) {
+    (void)config;
+    return true;
+}
+
+FILEIO_MEDIA_INFORMATION *FILEIO_SD_MediaInitialize(FILEIO_SD_DRIVE_CONFIG *config) {
+    (void)config;
+    media_information.errorCode = MEDIA_NO_ERROR;
+    media_information.validityFlags.bits.sectorSize = 1;
+    media_information.sectorSize = 512;
+    return &media_information;
+}
+
+bool FILEIO_SD_MediaDeinitialize(FILEIO_SD_DRIVE_CONFIG *config) {
+    (void)config;
+    return true;
+}
+
+bool FILEIO_SD_WriteProtectStateGet(FILEIO_SD_DRIVE_CONFIG *config) {
+    (void)config;
+    return false;
+}
+
+bool FILEIO_SD_SectorRead(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer) {
+    (void)config;
+    sd_image_reads++;
+    fseek(image, (long)sector_addr * 512, SEEK_SET);
+    return fread(buffer, 1, 512, image) == 512;
+}
+
+static bool sd_image_write(uint32_t sector_addr, uint8_t *buffer) {
+    sd_image_writes++;
+    busy_us = (sd_image_writes % 200 == 0) ? 180000 : 300 + sd_image_writes % 500;
+    time_us += busy_us + 550;
+    if (sector_addr >= fat_start && sector_addr < fat_end) {
+        sd_image_fat_writes++;
+    }
+    fseek(image, (long)sector_addr * 512, SEEK_SET);
+    return fwrite(buffer, 1, 512, image) == 512;
+}
+
+bool FILEIO_SD_SectorWrite(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer, bool allowWriteToZero) {
+    (void)config;
+    (void)allowWriteToZero;
+    sd_image_write_commands++;
+    return sd_image_write(sector_addr, buffer);
+}
+
+bool FILEIO_SD_SectorsWrite(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sector_addr, uint8_t *buffer, uint16_t sectorCount, bool allowWriteToZero) {
+    uint16_t i;
+
+    (void)config;
+    (void)allowWriteToZero;
+    sd_image_write_commands++;
+    for (i = 0; i < sectorCount; i++) {
+        if (!sd_image_write(sector_addr + i, buffer + i * 512)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t FILEIO_SD_SPIClockGet(void) {
+    return 0;
+}
+
+// A write stream is a run of sector writes on the card, on the image they
+// are just writes
+static uint32_t stream_sector;
+
+bool FILEIO_SD_WriteStreamStart(FILEIO_SD_DRIVE_CONFIG *config, uint32_t sectorAddress, uint32_t preEraseCount) {
+    (void)config;
+    (void)preEraseCount;
+    sd_image_write_commands++;
+    stream_sector = sectorAddress;
+    return true;
+}
+
+bool FILEIO_SD_WriteStreamPut(FILEIO_SD_DRIVE_CONFIG *config, uint8_t *buffer) {
+    (void)config;
+    return sd_image_write(stream_sector++, buffer);
+}
+
+bool FILEIO_SD_WriteStreamStop(FILEIO_SD_DRIVE_CONFIG *config) {
+    (void)config;
+    return true;
+}
@@ -0,0 +1,17 @@
+/*
+ * sd_image - the sd card of the firmware as an image file, for host tools
+ */
+
+#ifndef SD_IMAGE_H
+#define SD_IMAGE_H
+
+// Sectors read and written, written in the FAT, and write commands. A
+// multi-sector write is one command.
+extern long sd_image_reads, sd_image_writes, sd_image_fat_writes, sd_image_write_commands;
+// Debug output of the firmware to stderr
+extern int sd_image_verbose;
+
+// Opens a FAT32 image made by mkfat.py, exits when it can not
+void sd_image_open(const char *path);
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * xc.h for host builds of the firmware sources in tools/
+ *
+ * Only the registers and builtins that the sources used by the host tools
+ * touch, as plain variables and no-ops. Nothing here behaves like the part.
+ */
+
+#ifndef HOST_XC_H
+#define HOST_XC_H
+
+#include <stdint.h>
+
+typedef struct {
+    unsigned ANSB0:1, ANSA0:1, ANSA1:1, ANSA2:1;
+    unsigned TRISB0:1, TRISA0:1, TRISA1:1, TRISA2:1, TRISA3:1;
+    unsigned LATB0:1, RA3:1;
+} host_bits_t;
+
+extern volatile host_bits_t ANSELBbits, ANSELAbits, TRISBbits, TRISAbits, LATBbits, PORTAbits;
+extern volatile uint16_t _SDI1R, _RP18R, _RP17R, OSCCON;
+
+#define _RPOUT_SDO1                 5
+#define _RPOUT_SCK1                 6
+#define __builtin_write_OSCCONL(x)  (OSCCON = (x))
+#define ClrWdt()                    ((void)0)
+#define Nop()                       ((void)0)
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * File:        sd_log_decode.cpp
+ * Author:      Sunflare Solar Team
+ * Comments:    host tool that converts binary LOGxxxxx.BIN and delta encoded
+ *              LOGxxxxx.DLT files written by the SD card data logger back
+ *              into the logger's CSV layout
+ *
+ * Build:       g++ -std=c++17 -O2 -o sd_log_decode sd_log_decode.cpp
+ * Usage:       sd_log_decode LOG00000.BIN [LOG00000.CSV]
+ *              Without an output file the CSV is written to stdout.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Must match data_entry_value_type_t in device_logger_typedefs.h
+enum ValueType : uint8_t {
+    UINT32,
+    INT32,
+    UINT16,
+    INT16,
+    UINT8,
+    INT8,
+    HEX32,
+    HEX16,
+    HEX8
+};
+
+// Field sizes of the descriptors in device_logger_typedefs.h
+const size_t DEVICE_NAME_SIZE = 17;
+const size_t ENTRY_NAME_SIZE = 17;
+const size_t ENTRY_UNIT_SIZE = 9;
+
+const char BINARY_MAGIC[4] = {'S', 'F', 'L', 'B'};
+const char DELTA_MAGIC[4] = {'S', 'F', 'L', 'D'};
+// Version 2 added the layout crc to the header
+const uint16_t BINARY_VERSION = 2;
+
+// Record tags of the delta format, see SD_LOGGER_FORMAT_DELTA in sd_logger.h
+const uint8_t DELTA_KEYFRAME = 'K';
+const uint8_t DELTA_RECORD = 'D';
+
+struct Device {
+    std::string name;
+    uint16_t node_id;
+    uint16_t msg_count;
+};
+
+struct Entry {
+    std::string name;
+    std::string unit;
+    ValueType type;
+};
+
+struct Schema {
+    std::vector<Device> devices;
+    std::vector<Entry> entries;
+    uint16_t record_size;
+    uint16_t layout_crc;
+    bool delta;
+};
+
+// Same CRC 16 CCITT as utl_update_crc(), starting at UTL_CRC_INIT
+uint16_t crc16_ccitt(const uint8_t *data, size_t length) {
+    uint16_t crc = 0x1D0F;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= static_cast<uint16_t>(data[i] << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+class Reader {
+public:
+    explicit Reader(std::istream &in) : in_(in) {}
+
+    bool eof() {
+        return in_.peek() == std::char_traits<char>::eof();
+    }
+
+    void bytes(void *dest, size_t length) {
+        in_.read(static_cast<char *>(dest), length);
+        if (static_cast<size_t>(in_.gcount()) != length) {
+            throw std::runtime_error("unexpected end of file");
+        }
+        if (capture_) {
+            const uint8_t *p = static_cast<const uint8_t *>(dest);
+            capture_->insert(capture_->end(), p, p + length);
+        }
+    }
+
+    // Keeps a copy of everything read until called with nullptr
+    void capture(std::vector<uint8_t> *buffer) {
+        capture_ = buffer;
+    }
+
+    uint8_t u8() {
+        uint8_t value;
+        bytes(&value, 1);
+        return value;
+    }
+
+    uint16_t u16() {
+        uint8_t b[2];
+        bytes(b, 2);
+        return static_cast<uint16_t>(b[0] | (b[1] << 8));
+    }
+
+    std::string text(size_t size) {
+        std::vector<char> buffer(size);
+        bytes(buffer.data(), size);
+        size_t length = 0;
+        while (length < size && buffer[length] != '\0') {
+            length++;
+        }
+        return std::string(buffer.data(), length);
+    }
+
+private:
+    std::istream &in_;
+    std::vector<uint8_t> *capture_ = nullptr;
+};
+
+Schema read_schema(Reader &reader) {
+    char magic[4];
+    reader.bytes(magic, sizeof(magic));
+    Schema schema;
+    if (std::string(magic, 4) == std::string(BINARY_MAGIC, 4)) {
+        schema.delta = false;
+    } else if (std::string(magic, 4) == std::string(DELTA_MAGIC, 4)) {
+        schema.delta = true;
+    } else {
+        throw std::runtime_error("not a binary log file");
+    }
+    uint16_t version = reader.u16();
+    if (version < 1 || version > BINARY_VERSION) {
+        throw std::runtime_error("unsupported log version " + std::to_string(version));
+    }
+
+    uint16_t device_count = reader.u16();
+    uint16_t entry_count = reader.u16();
+    schema.record_size = reader.u16();
+    if (schema.record_size != (entry_count + 2) * 4) {
+        throw std::runtime_error("record size does not match entry count");
+    }
+    uint16_t stored_crc = version >= 2 ? reader.u16() : 0;
+
+    // The layout crc covers the device and entry descriptors
+    std::vector<uint8_t> schema_bytes;
+    reader.capture(&schema_bytes);
+
+    size_t total = 0;
+    for (uint16_t i = 0; i < device_count; i++) {
+        Device device;
+        device.name = reader.text(DEVICE_NAME_SIZE);
+        device.node_id = reader.u16();
+        device.msg_count = reader.u16();
+        total += device.msg_count;
+        schema.devices.push_back(device);
+    }
+    if (total != entry_count) {
+        throw std::runtime_error("device entry counts do not add up");
+    }
+
+    for (uint16_t i = 0; i < entry_count; i++) {
+        Entry entry;
+        entry.name = reader.text(ENTRY_NAME_SIZE);
+        entry.unit = reader.text(ENTRY_UNIT_SIZE);
+        entry.type = static_cast<ValueType>(reader.u8());
+        if (entry.type > HEX8) {
+            throw std::runtime_error("unknown value type in entry " + entry.name);
+        }
+        schema.entries.push_back(entry);
+    }
+    reader.capture(nullptr);
+
+    schema.layout_crc = crc16_ccitt(schema_bytes.data(), schema_bytes.size());
+    if (version >= 2 && stored_crc != schema.layout_crc) {
+        throw std::runtime_error("layout crc mismatch, header is corrupt");
+    }
+    return schema;
+}
+
+// Same three header rows as sd_logger_write_csv_header()
+void write_csv_header(const Schema &schema, std::ostream &out) {
+    char layout[16];
+    std::snprintf(layout, sizeof(layout), "layout %X;", static_cast<unsigned>(schema.layout_crc));
+    out << layout;
+    for (const Device &device : schema.devices) {
+        out << device.name;
+        for (uint16_t i = 0; i < device.msg_count; i++) {
+            out << ';';
+        }
+    }
+    out << "\r\nTimeSinceBoot;";
+    for (const Entry &entry : schema.entries) {
+        out << entry.name << ';';
+    }
+    out << "status;\r\nms;";
+    for (const Entry &entry : schema.entries) {
+        out << entry.unit << ';';
+    }
+    out << ";\r\n";
+}
+
+uint32_t get_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+// Formats a value the way sd_logger_write_csv_record() does
+void write_value(ValueType type, uint32_t raw, std::ostream &out) {
+    char text[16];
+    switch (type) {
+        case UINT32: std::snprintf(text, sizeof(text), "%lu", static_cast<unsigned long>(raw)); break;
+        case INT32:  std::snprintf(text, sizeof(text), "%ld", static_cast<long>(static_cast<int32_t>(raw))); break;
+        case UINT16: std::snprintf(text, sizeof(text), "%u", static_cast<unsigned>(raw & 0xFFFF)); break;
+        case INT16:  std::snprintf(text, sizeof(text), "%d", static_cast<int>(static_cast<int16_t>(raw & 0xFFFF))); break;
+        case UINT8:  std::snprintf(text, sizeof(text), "%u", static_cast<unsigned>(raw & 0xFF)); break;
+        case INT8:   std::snprintf(text, sizeof(text), "%d", static_cast<int>(static_cast<int8_t>(raw & 0xFF))); break;
+        case HEX32:  std::snprintf(text, sizeof(text), "%lX", static_cast<unsigned long>(raw)); break;
+        case HEX16:  std::snprintf(text, sizeof(text), "%X", static_cast<unsigned>(raw & 0xFFFF)); break;
+        case HEX8:   std::snprintf(text, sizeof(text), "%X", static_cast<unsigned>(raw & 0xFF)); break;
+    }
+    out << text;
+}
+
+// The logger stores utl_calc_crc() of time and data in the last word
+bool record_crc_ok(const std::vector<uint8_t> &record) {
+    size_t length = record.size() - 4;
+    return get_u32(&record[length]) == crc16_ccitt(record.data(), length);
+}
+
+void write_csv_record(const Schema &schema, const std::vector<uint8_t> &record, std::ostream &out) {
+    out << get_u32(&record[0]) << ';';
+    for (size_t i = 0; i < schema.entries.size(); i++) {
+        write_value(schema.entries[i].type, get_u32(&record[4 + i * 4]), out);
+        out << ';';
+    }
+    // Status column like sd_logger_write_csv_record()
+    out << (record_crc_ok(record) ? "ok;" : "crc error;") << "\r\n";
+}
+
+// Rebuilds the records of a delta file. A keyframe holds a whole record, a
+// delta record a bitmap of the words that changed and their new values.
+// After corrupt data decoding resumes at the next keyframe with a valid crc.
+size_t decode_delta(const Schema &schema, std::istream &in, std::ostream &out) {
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const size_t words = schema.record_size / 4;
+    const size_t bitmap_size = (words + 7) / 8;
+    std::vector<uint8_t> record(schema.record_size);
+    std::vector<uint8_t> next(schema.record_size);
+    bool synced = false;
+    size_t records = 0;
+    size_t pos = 0;
+
+    while (pos < data.size()) {
+        size_t start = pos;
+        bool ok = false;
+        if (data[pos] == DELTA_KEYFRAME && data.size() - pos > record.size()) {
+            std::copy(&data[pos + 1], &data[pos + 1] + next.size(), next.begin());
+            pos += 1 + next.size();
+            ok = record_crc_ok(next);
+        } else if (data[pos] == DELTA_RECORD && synced && data.size() - pos > bitmap_size) {
+            const uint8_t *bitmap = &data[pos + 1];
+            pos += 1 + bitmap_size;
+            next = record;
+            ok = true;
+            for (size_t i = 0; i < words && ok; i++) {
+                if (bitmap[i >> 3] & (1 << (i & 0x07))) {
+                    if (data.size() - pos < 4) {
+                        ok = false;
+                    } else {
+                        std::copy(&data[pos], &data[pos] + 4, &next[i * 4]);
+                        pos += 4;
+                    }
+                }
+            }
+            ok = ok && record_crc_ok(next);
+        }
+
+        if (ok) {
+            record.swap(next);
+            write_csv_record(schema, record, out);
+            records++;
+            synced = true;
+        } else {
+            if (synced) {
+                std::cerr << "corrupt record at offset " << start << ", skipping to next keyframe\n";
+            }
+            synced = false;
+            pos = start + 1;
+        }
+    }
+    return records;
+}
+
+size_t decode(std::istream &in, std::ostream &out) {
+    Reader reader(in);
+    Schema schema = read_schema(reader);
+    write_csv_header(schema, out);
+    if (schema.delta) {
+        return decode_delta(schema, in, out);
+    }
+
+    std::vector<uint8_t> record(schema.record_size);
+    size_t records = 0;
+    while (!reader.eof()) {
+        reader.bytes(record.data(), record.size());
+        write_csv_record(schema, record, out);
+        records++;
+    }
+    return records;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " LOGxxxxx.BIN|LOGxxxxx.DLT [output.csv]\n";
+        return 2;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return 1;
+    }
+
+    try {
+        size_t records;
+        if (argc == 3) {
+            std::ofstream out(argv[2], std::ios::binary);
+            if (!out) {
+                std::cerr << "cannot create " << argv[2] << "\n";
+                return 1;
+            }
+            records = decode(in, out);
+        } else {
+            records = decode(in, std::cout);
+        }
+        std::cerr << records << " records decoded\n";
+    } catch (const std::exception &e) {
+        std::cerr << argv[1] << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
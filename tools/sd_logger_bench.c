@@ -0,0 +1,105 @@
+/*
+ * sd_logger_bench - runs sd_logger.c and fileio.c on a FAT32 image
+ *
+ * Stores records of the current logging_buffer_t layout through the real
+ * sd_logger and fileio code into an image made by tools/host/mkfat.py and
+ * counts what reaches the card: sectors read and written, sectors written in
+ * the FAT and write commands. tools/host/fatcheck.py checks the image after
+ * and extracts the log files, so the output of two builds can be compared
+ * byte for byte.
+ *
+ * The records are the same on every run: a third of the values counts up,
+ * the rest is random, like a bus with a few busy devices. The log format and
+ * sync limits are the ones set in sd_logger.h.
+ *
+ * usage: sd_logger_bench image records [sync_every]
+ *   sync_every  also calls sd_logger_sync() every this many records, 0 for
+ *               only the automatic syncs like main.c
+ *
+ * Set V=1 for the debug output of the firmware, T=1 for the write timing
+ * histograms.
+ *
+ * Built with -DSD_LOGGER_BENCH_BASELINE it runs the sd_logger.c of the
+ * first commit instead, which opens, appends and closes the file for every
+ * chunk of a record. It has no sync and no stats, every record is on the
+ * card when it returns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sd_logger.h"
+#include "utl.h"
+#include "host/sd_image.h"
+
+int main(int argc, char **argv) {
+    logging_buffer_t buf = {0};
+    long records, sync_every = 0, reads, writes, fat_writes, commands, r;
+    uint16_t i;
+#if !defined(SD_LOGGER_BENCH_BASELINE)
+    sd_logger_stats_t stats;
+#endif
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s image records [sync_every]\n", argv[0]);
+        return 2;
+    }
+    records = atol(argv[2]);
+    if (argc > 3) {
+        sync_every = atol(argv[3]);
+    }
+    srand(1);
+    sd_image_open(argv[1]);
+    sd_image_verbose = getenv("V") != NULL;
+
+    if (sd_logger_init() != 0) {
+        fprintf(stderr, "no card mounted\n");
+        return 1;
+    }
+    reads = sd_image_reads;
+    writes = sd_image_writes;
+    fat_writes = sd_image_fat_writes;
+    commands = sd_image_write_commands;
+
+    for (r = 0; r < records; r++) {
+        buf.time_since_boot_ms = r * 1000;
+        for (i = 0; i < LOGGING_BUFFER_LEN; i++) {
+            buf.data[i].uint32 = (r % 3) ? (uint32_t)rand() * 2654435761u : i;
+        }
+        buf.crc = utl_calc_crc(buf.raw_uint8, LOGGING_BUFFER_RAW_8_LEN - 4);
+        sd_logger_store_logging_buffer(&buf);
+#if !defined(SD_LOGGER_BENCH_BASELINE)
+        // The main loop runs many times between two records
+        while (sd_logger_file_task()) {
+        }
+        if (sync_every != 0 && r % sync_every == sync_every - 1) {
+            sd_logger_sync();
+        }
+#endif
+    }
+#if defined(SD_LOGGER_BENCH_BASELINE)
+    (void)sync_every;
+    printf("records %ld reads %ld writes %ld fat_writes %ld write_commands %ld\n",
+           records, sd_image_reads - reads, sd_image_writes - writes, sd_image_fat_writes - fat_writes,
+           sd_image_write_commands - commands);
+#else
+    if (sd_logger_sync() != 0) {
+        fprintf(stderr, "last sync failed\n");
+        return 1;
+    }
+    if (sd_logger_get_records_synced() != (uint32_t)records) {
+        fprintf(stderr, "%lu records synced\n", (unsigned long)sd_logger_get_records_synced());
+        return 1;
+    }
+
+    if (getenv("T") != NULL) {
+        sd_image_verbose = 1;
+        sd_logger_print_timing();
+    }
+    sd_logger_get_stats(&stats);
+    printf("records %ld reads %ld writes %ld fat_writes %ld write_commands %ld syncs %lu sync_writes %lu\n",
+           records, sd_image_reads - reads, sd_image_writes - writes, sd_image_fat_writes - fat_writes,
+           sd_image_write_commands - commands, (unsigned long)stats.syncs, (unsigned long)stats.sync_sector_writes);
+#endif
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*
+ * File:        sd_ring_extract.cpp
+ * Author:      Sunflare Solar Team
+ * Comments:    host tool that reads the sector ring written by the SD card
+ *              data logger in SD_LOGGER_FORMAT_RAW and rebuilds the log of
+ *              every session in it as a binary log file
+ *
+ * Build:       g++ -std=c++17 -O2 -o sd_ring_extract sd_ring_extract.cpp
+ * Usage:       sd_ring_extract card.img|RING.RAW [output directory]
+ *              Writes SESSnnnnn.BIN for every session, convert them to CSV
+ *              with sd_log_decode.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Must match SD_LOGGER_FORMAT_RAW in sd_logger.h
+const size_t SECTOR_SIZE = 512;
+const char SUPER_MAGIC[4] = {'S', 'F', 'R', 'S'};
+const uint16_t RAW_VERSION = 1;
+const size_t SUPER_SIZE = 24;
+const char SECTOR_MAGIC[2] = {'S', 'R'};
+const size_t HEADER_SIZE = 16;
+const size_t DATA_SIZE = SECTOR_SIZE - HEADER_SIZE;
+const uint16_t NO_RECORD = 0xFFFF;
+
+// Schema block at the start of every session, see sd_log_decode.cpp
+const char BINARY_MAGIC[4] = {'S', 'F', 'L', 'B'};
+const size_t SCHEMA_FIXED_SIZE = 14;
+const size_t DEVICE_SIZE = 17 + 2 + 2;
+const size_t ENTRY_SIZE = 17 + 9 + 1;
+
+// Same CRC 16 CCITT as utl_update_crc(), starting at UTL_CRC_INIT
+uint16_t crc16_ccitt(const uint8_t *data, size_t length, uint16_t crc = 0x1D0F) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= static_cast<uint16_t>(data[i] << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint16_t get_u16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(get_u16(p)) | static_cast<uint32_t>(get_u16(p + 2)) << 16;
+}
+
+struct Ring {
+    uint64_t first_sector;      // Superblock, relative to the start of the image
+    uint32_t sector_count;
+    uint16_t id;
+    uint32_t head;
+    uint32_t tail;
+};
+
+struct Sector {
+    uint32_t sequence;
+    uint16_t session;
+    uint16_t first_record;
+    std::vector<uint8_t> data;
+};
+
+class Image {
+public:
+    explicit Image(std::ifstream &in) : in_(in) {
+        in_.seekg(0, std::ios::end);
+        sectors_ = static_cast<uint64_t>(in_.tellg()) / SECTOR_SIZE;
+    }
+
+    uint64_t sectors() const {
+        return sectors_;
+    }
+
+    bool read(uint64_t sector, uint8_t *buffer) {
+        if (sector >= sectors_) {
+            return false;
+        }
+        in_.clear();
+        in_.seekg(static_cast<std::streamoff>(sector * SECTOR_SIZE));
+        in_.read(reinterpret_cast<char *>(buffer), SECTOR_SIZE);
+        return static_cast<size_t>(in_.gcount()) == SECTOR_SIZE;
+    }
+
+private:
+    std::ifstream &in_;
+    uint64_t sectors_;
+};
+
+bool superblock_ok(const uint8_t *sector) {
+    return std::memcmp(sector, SUPER_MAGIC, 4) == 0 && get_u16(sector + 4) == RAW_VERSION &&
+           get_u32(sector + 8) >= 2 && get_u16(sector + SUPER_SIZE - 2) == crc16_ccitt(sector, SUPER_SIZE - 2);
+}
+
+// The ring is somewhere in a card image, or in a copy of the ring file
+Ring find_ring(Image &image) {
+    uint8_t sector[SECTOR_SIZE];
+    for (uint64_t i = 0; i < image.sectors(); i++) {
+        if (image.read(i, sector) && superblock_ok(sector) && i + get_u32(sector + 8) <= image.sectors()) {
+            Ring ring;
+            ring.first_sector = i;
+            ring.id = get_u16(sector + 6);
+            ring.sector_count = get_u32(sector + 8);
+            ring.head = get_u32(sector + 12);
+            ring.tail = get_u32(sector + 16);
+            return ring;
+        }
+    }
+    throw std::runtime_error("no ring superblock found");
+}
+
+// Like sd_logger_raw_sector_ok(), a sector of an earlier pass through the
+// ring has a different sequence number
+bool read_sector(Image &image, const Ring &ring, uint32_t sequence, Sector &result) {
+    uint8_t sector[SECTOR_SIZE];
+    if (!image.read(ring.first_sector + 1 + sequence % (ring.sector_count - 1), sector)) {
+        return false;
+    }
+    uint16_t length = get_u16(sector + 10);
+    if (std::memcmp(sector, SECTOR_MAGIC, 2) != 0 || get_u16(sector + 2) != ring.id ||
+        get_u32(sector + 4) != sequence || length > DATA_SIZE) {
+        return false;
+    }
+    uint16_t crc = crc16_ccitt(sector, 14);
+    crc = crc16_ccitt(sector + HEADER_SIZE, length, crc);
+    if (crc != get_u16(sector + 14)) {
+        return false;
+    }
+    result.sequence = sequence;
+    result.session = get_u16(sector + 8);
+    result.first_record = get_u16(sector + 12);
+    result.data.assign(sector + HEADER_SIZE, sector + HEADER_SIZE + length);
+    return true;
+}
+
+struct Session {
+    uint16_t number;
+    std::vector<Sector> sectors;
+    std::vector<uint8_t> schema;   // Schema block, empty if it was overwritten
+    size_t gaps = 0;
+};
+
+// The schema block at the start of a session, empty if the first sectors
+// of the session were overwritten
+std::vector<uint8_t> read_schema(const Session &session) {
+    std::vector<uint8_t> data;
+    if (session.sectors.front().first_record != 0) {
+        return data;
+    }
+    size_t size = SCHEMA_FIXED_SIZE;
+    uint32_t expected = session.sectors.front().sequence;
+    for (const Sector &sector : session.sectors) {
+        if (sector.sequence != expected++) {
+            break;
+        }
+        data.insert(data.end(), sector.data.begin(), sector.data.end());
+        if (data.size() >= SCHEMA_FIXED_SIZE && size == SCHEMA_FIXED_SIZE) {
+            if (std::memcmp(data.data(), BINARY_MAGIC, 4) != 0) {
+                break;
+            }
+            size += get_u16(&data[6]) * DEVICE_SIZE + get_u16(&data[8]) * ENTRY_SIZE;
+        }
+        if (data.size() >= size && size != SCHEMA_FIXED_SIZE) {
+            data.resize(size);
+            return data;
+        }
+    }
+    data.clear();
+    return data;
+}
+
+uint16_t schema_record_size(const std::vector<uint8_t> &schema) {
+    return get_u16(&schema[10]);
+}
+
+// Collects the valid sectors of the ring in order, grouped by session
+std::vector<Session> read_sessions(Image &image, Ring &ring) {
+    const uint32_t data_sectors = ring.sector_count - 1;
+    Sector sector;
+
+    // The logger may have written sectors after it last updated the
+    // superblock, find them the same way it does at mount
+    uint32_t end = ring.head;
+    while (end - ring.head < data_sectors && read_sector(image, ring, end, sector)) {
+        end++;
+        if (sector.data.size() != DATA_SIZE) {
+            break;
+        }
+    }
+    uint32_t start = end > data_sectors ? end - data_sectors : 0;
+    if (ring.tail > start && ring.tail <= end) {
+        start = ring.tail;
+    }
+
+    std::vector<Session> sessions;
+    bool gap = false;
+    for (uint32_t sequence = start; sequence != end; sequence++) {
+        if (!read_sector(image, ring, sequence, sector)) {
+            gap = true;
+            continue;
+        }
+        if (sessions.empty() || sessions.back().number != sector.session) {
+            Session session;
+            session.number = sector.session;
+            sessions.push_back(session);
+        } else if (gap) {
+            sessions.back().gaps++;
+        }
+        gap = false;
+        sessions.back().sectors.push_back(sector);
+    }
+    ring.head = end;
+    ring.tail = start;
+    return sessions;
+}
+
+// Rebuilds the binary log of a session: the schema block followed by the
+// records. After a lost sector the stream continues at the first record of
+// the next sector.
+size_t write_session(const Session &session, const std::vector<uint8_t> &schema, std::ostream &out) {
+    const size_t record_size = schema_record_size(schema);
+    std::vector<uint8_t> pending;
+    bool synced = false;
+    bool skip_schema = !session.schema.empty();
+    uint32_t expected = 0;
+    size_t records = 0;
+
+    out.write(reinterpret_cast<const char *>(schema.data()), schema.size());
+    for (const Sector &sector : session.sectors) {
+        if (!synced || sector.sequence != expected) {
+            pending.clear();
+            synced = sector.first_record != NO_RECORD && sector.first_record <= sector.data.size();
+            if (synced) {
+                pending.assign(sector.data.begin() + sector.first_record, sector.data.end());
+            }
+        } else {
+            pending.insert(pending.end(), sector.data.begin(), sector.data.end());
+        }
+        expected = sector.sequence + 1;
+        if (skip_schema && pending.size() >= session.schema.size()) {
+            pending.erase(pending.begin(), pending.begin() + session.schema.size());
+            skip_schema = false;
+        }
+        size_t used = 0;
+        while (!skip_schema && pending.size() - used >= record_size) {
+            out.write(reinterpret_cast<const char *>(&pending[used]), record_size);
+            used += record_size;
+            records++;
+        }
+        pending.erase(pending.begin(), pending.begin() + used);
+    }
+    return records;
+}
+
+size_t extract(Image &image, const std::string &directory) {
+    Ring ring = find_ring(image);
+    std::vector<Session> sessions = read_sessions(image, ring);
+    std::cerr << "ring at sector " << ring.first_sector << ", " << ring.sector_count << " sectors, sequence "
+              << ring.tail << " to " << ring.head << "\n";
+
+    // A session whose start was overwritten borrows the schema of another
+    // one, the record crc shows whether the layout was the same
+    std::vector<uint8_t> fallback;
+    for (Session &session : sessions) {
+        session.schema = read_schema(session);
+        if (fallback.empty()) {
+            fallback = session.schema;
+        }
+    }
+
+    size_t total = 0;
+    for (const Session &session : sessions) {
+        const std::vector<uint8_t> &schema = session.schema.empty() ? fallback : session.schema;
+        if (schema.empty()) {
+            std::cerr << "session " << session.number << ": no schema, skipped\n";
+            continue;
+        }
+        char name[16];
+        std::snprintf(name, sizeof(name), "SESS%05u.BIN", static_cast<unsigned>(session.number));
+        std::string path = directory + "/" + name;
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            throw std::runtime_error("cannot create " + path);
+        }
+        size_t records = write_session(session, schema, out);
+        std::cerr << name << ": " << session.sectors.size() << " sectors, " << records << " records";
+        if (session.schema.empty()) {
+            std::cerr << ", start overwritten";
+        }
+        if (session.gaps != 0) {
+            std::cerr << ", " << session.gaps << " gaps";
+        }
+        std::cerr << "\n";
+        total += records;
+    }
+    return total;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " card.img|RING.RAW [output directory]\n";
+        return 2;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return 1;
+    }
+
+    try {
+        Image image(in);
+        size_t records = extract(image, argc == 3 ? argv[2] : ".");
+        std::cerr << records << " records extracted\n";
+    } catch (const std::exception &e) {
+        std::cerr << argv[1] << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * utl_conv_bench - checks and times the integer to text conversion of utl.c
+ *
+ * Compares utl_uint32_to_dec, utl_int32_to_dec and utl_uint32_to_hex, and
+ * the cursor functions built on them, with printf over the 32-bit range:
+ * every value below 200000 and every 7919th above, plus the edge cases.
+ * Then times the new conversions against utl_uint32_to_string, which they
+ * replace in the log output.
+ *
+ * The host divides in hardware, the dsPIC calls a library routine for every
+ * 32-bit division, so the gain on the logger is larger than shown here.
+ *
+ * usage: utl_conv_bench
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "utl.h"
+
+#define BENCH_COUNT 20000000L
+
+static unsigned long mismatches;
+
+static void cursor_spill(utl_cursor_t *cursor) {
+    cursor->length = 0;
+}
+
+static void check(const char *name, const char *got, uint8_t length, const char *expected) {
+    if (strcmp(got, expected) != 0 || length != strlen(expected)) {
+        if (mismatches < 10) {
+            printf("%s: \"%s\" (%u) expected \"%s\"\n", name, got, length, expected);
+        }
+        mismatches++;
+    }
+}
+
+static void check_value(uint32_t value) {
+    char got[16], expected[16], cursor_buffer[8];
+    utl_cursor_t cursor = { cursor_buffer, 0, sizeof(cursor_buffer), cursor_spill };
+    uint8_t length;
+
+    length = utl_uint32_to_dec(value, got);
+    sprintf(expected, "%u", (unsigned)value);
+    check("utl_uint32_to_dec", got, length, expected);
+    length = utl_int32_to_dec((int32_t)value, got);
+    sprintf(expected, "%d", (int)(int32_t)value);
+    check("utl_int32_to_dec", got, length, expected);
+    length = utl_uint32_to_hex(value, got);
+    sprintf(expected, "%X", (unsigned)value);
+    check("utl_uint32_to_hex", got, length, expected);
+
+    // Too small a buffer for the digits, so the spill path is checked too,
+    // only the length is compared
+    sprintf(expected, "%u", (unsigned)value);
+    length = utl_cursor_put_uint32(&cursor, value);
+    if (length != strlen(expected)) {
+        mismatches++;
+    }
+    sprintf(expected, "%d", (int)(int32_t)value);
+    length = utl_cursor_put_int32(&cursor, (int32_t)value);
+    if (length != strlen(expected)) {
+        mismatches++;
+    }
+    sprintf(expected, "%X", (unsigned)value);
+    length = utl_cursor_put_hex32(&cursor, value);
+    if (length != strlen(expected)) {
+        mismatches++;
+    }
+}
+
+static double now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    static const uint32_t edges[] = {
+        0, 9, 10, 99, 100, 65535, 65536, 99999, 100000, 999999999,
+        1000000000, 2147483647, 2147483648u, 4294967295u
+    };
+    volatile uint32_t sink = 0;
+    char str[16];
+    uint64_t value;
+    uint32_t x;
+    double start;
+    long i;
+    unsigned e;
+
+    for (value = 0; value <= 0xFFFFFFFFull; value += (value < 200000) ? 1 : 7919) {
+        check_value((uint32_t)value);
+    }
+    for (e = 0; e < sizeof(edges) / sizeof(edges[0]); e++) {
+        check_value(edges[e]);
+    }
+    printf("mismatches %lu\n", mismatches);
+
+    // The same pseudo random values for every conversion
+    start = now();
+    for (i = 0, x = 1; i < BENCH_COUNT; i++) {
+        x = x * 1664525u + 1013904223u;
+        utl_uint32_to_string(x, str, 10);
+        sink += str[0];
+    }
+    printf("utl_uint32_to_string dec %.1f ns\n", (now() - start) / BENCH_COUNT * 1e9);
+    start = now();
+    for (i = 0, x = 1; i < BENCH_COUNT; i++) {
+        x = x * 1664525u + 1013904223u;
+        utl_uint32_to_dec(x, str);
+        sink += str[0];
+    }
+    printf("utl_uint32_to_dec        %.1f ns\n", (now() - start) / BENCH_COUNT * 1e9);
+    start = now();
+    for (i = 0, x = 1; i < BENCH_COUNT; i++) {
+        x = x * 1664525u + 1013904223u;
+        utl_uint32_to_string(x, str, 16);
+        sink += str[0];
+    }
+    printf("utl_uint32_to_string hex %.1f ns\n", (now() - start) / BENCH_COUNT * 1e9);
+    start = now();
+    for (i = 0, x = 1; i < BENCH_COUNT; i++) {
+        x = x * 1664525u + 1013904223u;
+        utl_uint32_to_hex(x, str);
+        sink += str[0];
+    }
+    printf("utl_uint32_to_hex        %.1f ns\n", (now() - start) / BENCH_COUNT * 1e9);
+
+    return mismatches != 0 ? 1 : 0;
+}